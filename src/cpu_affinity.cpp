@@ -0,0 +1,106 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "cpu_affinity.h"
+
+bool cpu_list_parse(const char* list, vector<int>& cpus) {
+	long int ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	const char* p = list;
+	char* endptr;
+
+	cpus.clear();
+	while(*p) {
+		long int first = strtol(p, &endptr, 10);
+		long int last = first;
+		if(endptr == p || first < 0) {
+			return false;
+		}
+		p = endptr;
+		if(*p == '-') {
+			last = strtol(p + 1, &endptr, 10);
+			if(endptr == p + 1 || last < first) {
+				return false;
+			}
+			p = endptr;
+		}
+		if(last >= ncpus || last >= CPU_SETSIZE) {
+			return false;
+		}
+		for(long int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+
+		if(*p == ',') {
+			p++;
+		} else if(*p != '\0') {
+			return false;
+		}
+	}
+	return !cpus.empty();
+}
+
+bool cpu_attr_pin(pthread_attr_t* attr, int cpu) {
+	cpu_set_t set;
+	int err;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(0 != (err = pthread_attr_setaffinity_np(attr, sizeof(set), &set))) {
+		fprintf(stderr, "error: failed to pin thread to CPU %d. Reason: %s\n", cpu, strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool cpu_pin_self(int cpu, cpu_set_t* saved) {
+	cpu_set_t set;
+	int err;
+
+	if(saved && 0 != (err = pthread_getaffinity_np(pthread_self(), sizeof(*saved), saved))) {
+		fprintf(stderr, "error: failed to get thread CPU affinity. Reason: %s\n", strerror(err));
+		return false;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(0 != (err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set))) {
+		fprintf(stderr, "error: failed to pin thread to CPU %d. Reason: %s\n", cpu, strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool cpu_restore_self(const cpu_set_t* saved) {
+	int err;
+
+	if(0 != (err = pthread_setaffinity_np(pthread_self(), sizeof(*saved), saved))) {
+		fprintf(stderr, "warning: failed to restore thread CPU affinity. Reason: %s\n", strerror(err));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,46 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+using namespace std;
+
+/* Parse a CPU list such as "0-3,8,10-11" into cpus. Returns false if the
+   list is malformed or names a CPU this machine does not have. */
+bool cpu_list_parse(const char* list, vector<int>& cpus);
+
+/* Set attr so a thread created with it starts (and stays) on cpu. Pinning
+   before the thread runs means everything it allocates and touches first
+   comes from the memory node local to that core. */
+bool cpu_attr_pin(pthread_attr_t* attr, int cpu);
+
+/* Move the calling thread to cpu. If saved is not NULL, the thread's previous
+   affinity is stored there for cpu_restore_self(). */
+bool cpu_pin_self(int cpu, cpu_set_t* saved);
+bool cpu_restore_self(const cpu_set_t* saved);
+
+#endif /* CPU_AFFINITY_H */
@@ -23,6 +23,7 @@
 #include <getopt.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #ifdef HAVE_LIBCAP_NG
 	#include <cap-ng.h>
@@ -32,11 +33,56 @@
 
 #include "subnet_list.h"
 #include "degreaser.h"
+#include "scan.h"
 #include "scanner.h"
 #include "linux_firewall.h"
+#include "output_writer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "pcap_writer.h"
+#include "port_allocator.h"
+#include "signature.h"
+#include "prefix_tracker.h"
+#include "result_store.h"
+#include "priority.h"
+#include "cpu_affinity.h"
+#include "retry_pass.h"
+#include "unreachable_cache.h"
 #include "output/output_console.h"
 #include "output/output_curses.h"
 #include "output/output_csv.h"
+#include "output/output_binary.h"
+#include "output/output_json.h"
+#include "output/output_store.h"
+
+/* Options that only have a long form */
+enum {	OPT_METRICS_FILE = 256,
+		OPT_METRICS_LISTEN,
+		OPT_TRACE,
+		OPT_PCAP_ROTATE_SIZE,
+		OPT_PCAP_ROTATE_TIME,
+		OPT_PCAPNG,
+		OPT_PCAP_FILTER,
+		OPT_FIREWALL,
+		OPT_SRC_PORTS,
+		OPT_SINGLE_PROBE,
+		OPT_SIGNATURES,
+		OPT_SIGNATURE_THRESHOLD,
+		OPT_ADAPTIVE,
+		OPT_ADAPTIVE_SAMPLE,
+		OPT_TARPIT_RANGES,
+		OPT_STORE,
+		OPT_INCREMENTAL,
+		OPT_STALE_AFTER,
+		OPT_PRIORITY,
+		OPT_ENGINE,
+		OPT_MAX_INFLIGHT,
+		OPT_CPUS,
+		OPT_RETRY_PASSES,
+		OPT_RETRY_DELAY,
+		OPT_UNREACHABLE_SKIP,
+		OPT_UNREACHABLE_SAMPLE,
+		OPT_JSON };
 
 static struct option long_options[] = {
 	{"dev",				required_argument,	0,	'd'},
@@ -48,6 +94,8 @@ static struct option long_options[] = {
 	{"input-file",		required_argument,	0,	'i'},
 	{"skip-lines",		required_argument,	0,	's'},
 	{"output-file",		required_argument,	0,	'o'},
+	{"binary-output",	required_argument,	0,	'b'},
+	{"json",			required_argument,	0,	OPT_JSON},
 	{"all-scans",		no_argument,		0,	'a'},
 	{"dry-run",			no_argument,		0,	'D'},
 	{"sequential",		no_argument,		0,	's'},
@@ -56,6 +104,32 @@ static struct option long_options[] = {
 	{"pcap",			required_argument,	0,	'P'},
 	{"exclude",			required_argument,	0,	'x'},
 	{"exclude-rfc6890",	required_argument,	0,	'X'},
+	{"metrics-file",	required_argument,	0,	OPT_METRICS_FILE},
+	{"metrics-listen",	required_argument,	0,	OPT_METRICS_LISTEN},
+	{"trace",			required_argument,	0,	OPT_TRACE},
+	{"pcap-rotate-size",	required_argument,	0,	OPT_PCAP_ROTATE_SIZE},
+	{"pcap-rotate-time",	required_argument,	0,	OPT_PCAP_ROTATE_TIME},
+	{"pcapng",			no_argument,		0,	OPT_PCAPNG},
+	{"pcap-filter",		required_argument,	0,	OPT_PCAP_FILTER},
+	{"firewall",		required_argument,	0,	OPT_FIREWALL},
+	{"src-ports",		required_argument,	0,	OPT_SRC_PORTS},
+	{"single-probe",	no_argument,		0,	OPT_SINGLE_PROBE},
+	{"signatures",		required_argument,	0,	OPT_SIGNATURES},
+	{"signature-threshold",	required_argument,	0,	OPT_SIGNATURE_THRESHOLD},
+	{"adaptive",		optional_argument,	0,	OPT_ADAPTIVE},
+	{"adaptive-sample",	required_argument,	0,	OPT_ADAPTIVE_SAMPLE},
+	{"tarpit-ranges",	required_argument,	0,	OPT_TARPIT_RANGES},
+	{"store",			required_argument,	0,	OPT_STORE},
+	{"incremental",		no_argument,		0,	OPT_INCREMENTAL},
+	{"stale-after",		required_argument,	0,	OPT_STALE_AFTER},
+	{"priority",		required_argument,	0,	OPT_PRIORITY},
+	{"engine",			required_argument,	0,	OPT_ENGINE},
+	{"max-inflight",	required_argument,	0,	OPT_MAX_INFLIGHT},
+	{"cpus",			required_argument,	0,	OPT_CPUS},
+	{"retry-passes",	required_argument,	0,	OPT_RETRY_PASSES},
+	{"retry-delay",		required_argument,	0,	OPT_RETRY_DELAY},
+	{"unreachable-skip",	optional_argument,	0,	OPT_UNREACHABLE_SKIP},
+	{"unreachable-sample",	required_argument,	0,	OPT_UNREACHABLE_SAMPLE},
 	{NULL,				0,					0,	0}
 };
 
@@ -64,6 +138,13 @@ void usage(char* prog) {
 	fprintf(stderr, "Configuration Options:\n"
 	                "  -d, --dev=<dev>            Network device to capture from.\n"
 	                "  -t, --max-threads=<num>    Maximum number of threads to use (default: 10).\n"
+	                "      --engine=<type>        threads: one blocking scan per thread (default).\n"
+	                "                             event: one thread drives many scans at once.\n"
+	                "      --max-inflight=<num>   Scans in flight at once with --engine=event\n"
+	                "                             (default: 1024, per worker with --cpus).\n"
+	                "      --cpus=<list>          Pin workers to these CPUs (e.g. 0-3,8). With\n"
+	                "                             --engine=event, runs one engine per CPU and\n"
+	                "                             splits replies between them by source port.\n"
 	                "  -h, --help                 Show this message.\n"
 	                "  -q, --quiet                Don't print to the console.\n"
 	                "Scan Options:\n"
@@ -72,16 +153,66 @@ void usage(char* prog) {
 	                "  -a, --all-scans            Output results from all scans, not just LaBrea hosts.\n"
 	                "  -D, --dry-run              Simulate scan, but don't actually send out packets.\n"
 	                "  -f, --fast-scan            Performs a fast scan.\n"
+	                "      --retry-passes=<num>   Send each SYN once, then re-probe the hosts that did\n"
+	                "                             not answer in this many passes at the end.\n"
+	                "      --retry-delay=<sec>    Wait between retry passes (default: 10).\n"
+	                "      --single-probe         Classify hosts from the SYN/ACK when it matches a known\n"
+	                "                             tarpit signature, skipping the follow-up probes.\n"
+	                "      --signatures=<file>    Load extra signatures from this file (implies\n"
+	                "                             --single-probe).\n"
+	                "      --signature-threshold=<num> Minimum signature confidence, 0-100 (default: 75).\n"
+	                "      --adaptive[=<num>]     After this many identical tarpit results in a /24\n"
+	                "                             (default: 8), only sample the rest of it.\n"
+	                "      --adaptive-sample=<num> Probe one in this many addresses of a tarpit /24\n"
+	                "                             (default: 16).\n"
+	                "      --tarpit-ranges=<file> Write the /24s found to be tarpit ranges to this file\n"
+	                "                             (implies --adaptive).\n"
+	                "      --unreachable-skip[=<num>] After this many ICMP unreachable errors from one\n"
+	                "                             router for a /24 (default: 4), only sample the rest.\n"
+	                "      --unreachable-sample=<num> Probe one in this many addresses of an unreachable\n"
+	                "                             /24, 0 for none (default: 32).\n"
+	                "      --firewall=<mode>      How to keep the kernel from resetting scan connections:\n"
+	                "                             auto, nftables, iptables or none (default: auto).\n"
+	                "                             Rules are removed on exit and on SIGINT/TERM/HUP/QUIT.\n"
+	                "                             Only nftables through libnftables also removes them\n"
+	                "                             after a crash; otherwise a crash leaves them behind.\n"
+	                "      --src-ports=<min-max>  Source ports to scan from. Each scan in flight holds\n"
+	                "                             its own port (default: 1000 ports below the\n"
+	                "                             ephemeral port range).\n"
 	                "Subnet Options:\n"
 	                "  -i, --input-file=<file>    Input file to read subnets from.\n"
 	                "  -o, --output-file=<file>   Write output to this file.\n"
+	                "  -b, --binary-output=<file> Write results to this file in binary format (see degreaser-read).\n"
+	                "      --json=<file>          Stream results to this file as newline-delimited JSON.\n"
+	                "                             Use '-' for standard output (implies -q).\n"
 					"  -x, --exclude=<file>       List of subnets to exclude from the scan.\n"
 					"      --exclude-rfc6890=<yes/no> Exclude RFC 6890 special-purpose addresses <default: yes>.\n"
 #ifdef HAVE_LIBCPERM
 	                "  -s, --sequential           Perform a sequential scan.\n"
 	                "  -r, --random               Perform a random scan (default).\n"
 #endif /* HAVE_LIBCPERM */
+	                "      --priority=<file>      Scan the /24s with the most tarpits in this previous\n"
+	                "                             binary output or result store first. Also takes a\n"
+	                "                             text file of '<prefix> <score>' lines.\n"
+	                "      --store=<file>         Keep the latest result for every address in this file,\n"
+	                "                             updated at the end of each run.\n"
+	                "      --incremental          Only probe addresses that are new, answered before,\n"
+	                "                             are stale or whose /24 changed in the last run\n"
+	                "                             (needs --store).\n"
+	                "      --stale-after=<days>   Rescan silent addresses after this long (default: 30).\n"
 	                "  -P, --pcap=<file>          Save all packets sent and received to a PCAP file.\n"
+	                "      --pcapng               Write the packet capture in pcapng format.\n"
+	                "      --pcap-rotate-size=<MB> Start a new capture file after this many megabytes.\n"
+	                "      --pcap-rotate-time=<sec> Start a new capture file after this many seconds.\n"
+	                "      --pcap-filter=<results> Only save the packets of scans with one of these\n"
+	                "                             comma separated results, e.g. labrea,iptables,delude,\n"
+	                "                             zero_window,tarpit,errors.\n"
+	                "Monitoring Options:\n"
+	                "      --metrics-file=<file>  Periodically write Prometheus metrics to this file.\n"
+	                "      --metrics-listen=<addr> Serve Prometheus metrics over HTTP. <addr> is a port\n"
+	                "                             on 127.0.0.1, <ip>:<port> or unix:<path>.\n"
+	                "      --trace=<file>         Record per-stage timings and write them to this file\n"
+	                "                             as Chrome trace JSON (chrome://tracing, Perfetto).\n"
 	                "\n"
 	                "Subnets to scan can be specified on the command line or read from a file\n"
 	                "specified using the -i switch. If no subnets are given and no input file\n"
@@ -101,6 +232,16 @@ void usage(char* prog) {
 					"LIBCURSES=1 "
 #else
 					"LIBCURSES=0 "
+#endif
+#ifdef HAVE_LIBNFTABLES
+					"LIBNFTABLES=1 "
+#else
+					"LIBNFTABLES=0 "
+#endif
+#ifdef HAVE_SYS_SDT_H
+					"USDT=1 "
+#else
+					"USDT=0 "
 #endif
 					"\n\n");
 }
@@ -123,6 +264,78 @@ void capability_check() {
 #endif /* HAVE_LIBCAP_NG */
 }
 
+/* Parses a comma separated list of result names into a SCAN_RESULT_BIT mask.
+   "errors" is shorthand for all of the error results. */
+bool parse_result_list(const char* list, uint32_t* mask) {
+	char* copy = strdup(list);
+	char* saveptr;
+	int result;
+
+	*mask = 0;
+	for(char* name = strtok_r(copy, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+		if(0 == strcmp(name, "errors")) {
+			*mask |= SCAN_RESULT_BIT(UNREACHABLE) | SCAN_RESULT_BIT(FLAGS_ERROR) | SCAN_RESULT_BIT(TCP_ERROR);
+		} else if(scan_result_from_name(name, &result)) {
+			*mask |= SCAN_RESULT_BIT(result);
+		} else {
+			free(copy);
+			return false;
+		}
+	}
+
+	free(copy);
+	return *mask != 0;
+}
+
+void print_summary(DegreaserConfig& config) {
+	Stats totals;
+	LatencyStats latency;
+
+	config.stats.aggregate(&totals);
+	config.stats.aggregate_latency(&latency);
+
+	double scans = totals.scans ? totals.scans : 1;
+	fprintf(stderr, "Total Scanned Hosts: %" PRIu64 "\n", totals.scans);
+	fprintf(stderr, "Total Responding Hosts: %" PRIu64 " (%.2f%%)\n", totals.hits,
+			totals.hits / scans * 100);
+	fprintf(stderr, "Total Tarpit Hosts: %" PRIu64 " (%.2f%%)\n", totals.tarpits,
+			totals.tarpits / scans * 100);
+	fprintf(stderr, "Total LaBrea Hosts: %" PRIu64 " (%.2f%%)\n", totals.labrea,
+			totals.labrea / scans * 100);
+	fprintf(stderr, "Total iptables Hosts: %" PRIu64 " (%.2f%%)\n", totals.iptables,
+			totals.iptables / scans * 100);
+	fprintf(stderr, "Total Excluded Hosts: %" PRIu64 "\n", totals.excluded);
+	if(totals.send_errors) {
+		fprintf(stderr, "Total Send Errors: %" PRIu64 "\n", totals.send_errors);
+	}
+	if(config.store) {
+		fprintf(stderr, "Total Unchanged Hosts: %" PRIu64 "\n", totals.unchanged);
+	}
+	if(config.unreachable) {
+		fprintf(stderr, "Total Unreachable /24s: %u (%" PRIu64 " hosts skipped)\n",
+				config.unreachable->dark_prefixes(), totals.dark_skipped);
+	}
+	if(config.retry) {
+		fprintf(stderr, "Total Retried Probes: %" PRIu64 "\n", totals.retried);
+	}
+	if(config.prefixes) {
+		fprintf(stderr, "Total Tarpit /24s: %u (%" PRIu64 " hosts skipped)\n",
+				config.prefixes->tarpit_ranges(), totals.skipped);
+	}
+
+	fprintf(stderr, "\nResponse Times (us):\n");
+	fprintf(stderr, "  %-12s %10s %10s %10s %10s %10s %10s\n", "Result", "Count", "p50", "p90", "p99", "p99.9", "Max");
+	for(int i = 0; i < LATENCY_CLASSES; i++) {
+		Histogram& h = latency.response_time[i];
+		if(h.count() == 0) {
+			continue;
+		}
+		fprintf(stderr, "  %-12s %10" PRIu64 " %10u %10u %10u %10u %10u\n",
+				LatencyStats::class_name(i), h.count(),
+				h.percentile(0.5), h.percentile(0.9), h.percentile(0.99), h.percentile(0.999), h.max());
+	}
+}
+
 void load_from_file(SubnetList* subnet_list, string fn) {
 	FILE* fd = fopen(fn.c_str(), "r");
 	char* line = NULL;
@@ -142,7 +355,6 @@ void load_from_file(SubnetList* subnet_list, string fn) {
 }
 
 int main(int argc, char** argv) {
-	list<pthread_t> threads;
 	list<string> input_files;
 	list<string> exclude_files;
 	DegreaserConfig config;
@@ -150,37 +362,29 @@ int main(int argc, char** argv) {
 	int c;
 	int opt_index;
 	long int port;
-	pthread_t tid;
-	/* Set default config values */
-	config.device = "";
-	config.max_threads = 10;
-	config.port = 80;
-	config.win_threshold = 20;
-	config.verbose = 1;
-	config.retries = 1;
-	config.timeout = 5;
-	config.total_scans = 0;
-	config.total_hits = 0;
-	config.total_tarpits = 0;
-	config.total_labrea = 0;
-	config.total_iptables = 0;
-	config.total_delude = 0;
-	config.total_excluded = 0;
-	config.total_real = 0;
-	config.total_rejecting = 0;
-	config.total_errors = 0;
-	config.all_scans = false;
-	config.dry_run = false;
-	config.random = true;
-	config.fast_scan = false;
-	config.exclude_rfc6890 = true;
-	config.pcap_handle = NULL;
-	config.pcap_dumper = NULL;
-	pthread_mutex_init(&config.global_lock, NULL);
-	pthread_mutex_init(&config.pcap_lock, NULL);
+	long int value;
+	MetricsExporter* metrics;
+	PcapFormat pcap_format = PCAP_FORMAT_PCAP;
+	uint64_t pcap_rotate_size = 0;
+	uint32_t pcap_rotate_time = 0;
+	bool adaptive = false;
+	uint16_t adaptive_threshold = 8;
+	uint16_t adaptive_sample = 16;
+	bool unreachable_skip = false;
+	uint16_t unreachable_threshold = 4;
+	uint16_t unreachable_sample = 32;
+	string tarpit_ranges_file;
+	string store_file;
+	string priority_file;
+	bool incremental = false;
+	uint32_t stale_after = 30;
+	uint8_t retry_passes = 0;
+	uint32_t retry_delay = 10;
+	scanner_defaults(&config);
+	metrics = new MetricsExporter(&config);
 
 	/* Process command line arguments */
-	while(-1 != (c = getopt_long(argc, argv, "d:t:p:w:hqi:o:aDrsP:fx:X:", long_options, &opt_index))) {
+	while(-1 != (c = getopt_long(argc, argv, "d:t:p:w:hqi:o:b:aDrsP:fx:X:", long_options, &opt_index))) {
 		switch(c) {
 			case 'd':
 				config.device = optarg;
@@ -216,12 +420,21 @@ int main(int argc, char** argv) {
 			case 'o':
 				config.outputs.push_back(new OutputCSV(&config, optarg));
 				break;
+			case 'b':
+				config.outputs.push_back(new OutputBinary(&config, optarg));
+				break;
+			case OPT_JSON:
+				 /* Keep the console output out of the stream */
+				 if(0 == strcmp(optarg, "-")) {
+					 config.verbose = 0;
+				 }
+				 config.outputs.push_back(new OutputJSON(&config, optarg));
+				 break;
 			case 'a':
 				config.all_scans = true;
 				 break;
 			case 'D':
 				 config.dry_run = true;
-				 Scan::dry_run = true;
 				 LOG_DEBUG("degreaser running in dry run mode. No packets will be sent.\n");
 				 break;
 			case 's':
@@ -242,6 +455,171 @@ int main(int argc, char** argv) {
 			case 'X':
 				 config.exclude_rfc6890 = false;
 				 break;
+			case OPT_SRC_PORTS:
+				 if(2 != sscanf(optarg, "%hu-%hu", &config.src_port_min, &config.src_port_max)
+						 || config.src_port_min == 0 || config.src_port_min > config.src_port_max) {
+					 fprintf(stderr, "error: invalid source port range (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_SINGLE_PROBE:
+			case OPT_SIGNATURES:
+				 if(!config.signatures) {
+					 config.signatures = new SignatureTable();
+					 config.signatures->add_defaults();
+				 }
+				 if(c == OPT_SIGNATURES && !config.signatures->load(optarg)) {
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_SIGNATURE_THRESHOLD:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 0 || value > 100) {
+					 fprintf(stderr, "error: invalid signature threshold (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 config.signature_threshold = value;
+				 break;
+			case OPT_ADAPTIVE:
+				 adaptive = true;
+				 if(optarg) {
+					 value = strtol(optarg, &endptr, 10);
+					 if(*endptr != '\0' || value < 1 || value > 256) {
+						 fprintf(stderr, "error: invalid adaptive threshold (%s)\n", optarg);
+						 exit(EXIT_FAILURE);
+					 }
+					 adaptive_threshold = value;
+				 }
+				 break;
+			case OPT_ADAPTIVE_SAMPLE:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 1 || value > 256) {
+					 fprintf(stderr, "error: invalid adaptive sample rate (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 adaptive_sample = value;
+				 break;
+			case OPT_TARPIT_RANGES:
+				 adaptive = true;
+				 tarpit_ranges_file = optarg;
+				 break;
+			case OPT_UNREACHABLE_SKIP:
+				 unreachable_skip = true;
+				 if(optarg) {
+					 value = strtol(optarg, &endptr, 10);
+					 if(*endptr != '\0' || value < 1 || value > 256) {
+						 fprintf(stderr, "error: invalid unreachable threshold (%s)\n", optarg);
+						 exit(EXIT_FAILURE);
+					 }
+					 unreachable_threshold = value;
+				 }
+				 break;
+			case OPT_UNREACHABLE_SAMPLE:
+				 unreachable_skip = true;
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 0 || value > 256) {
+					 fprintf(stderr, "error: invalid unreachable sample rate (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 unreachable_sample = value;
+				 break;
+			case OPT_ENGINE:
+				 if(0 == strcmp(optarg, "event")) {
+					 config.event_engine = true;
+				 } else if(0 == strcmp(optarg, "threads")) {
+					 config.event_engine = false;
+				 } else {
+					 fprintf(stderr, "error: invalid engine (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_MAX_INFLIGHT:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 1 || value > 65535) {
+					 fprintf(stderr, "error: invalid number of scans in flight (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 config.max_inflight = value;
+				 break;
+			case OPT_CPUS:
+				 if(!cpu_list_parse(optarg, config.cpus)) {
+					 fprintf(stderr, "error: invalid CPU list (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_RETRY_PASSES:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 0 || value > 255) {
+					 fprintf(stderr, "error: invalid number of retry passes (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 retry_passes = value;
+				 break;
+			case OPT_RETRY_DELAY:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 0 || value > 86400) {
+					 fprintf(stderr, "error: invalid retry delay (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 retry_delay = value;
+				 break;
+			case OPT_PRIORITY:
+				 priority_file = optarg;
+				 break;
+			case OPT_STORE:
+				 store_file = optarg;
+				 break;
+			case OPT_INCREMENTAL:
+				 incremental = true;
+				 break;
+			case OPT_STALE_AFTER:
+				 value = strtol(optarg, &endptr, 10);
+				 if(*endptr != '\0' || value < 0 || value > 3650) {
+					 fprintf(stderr, "error: invalid stale time (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 stale_after = value;
+				 break;
+			case OPT_FIREWALL:
+				 if(!linux_firewall_parse_mode(optarg, &config.firewall)) {
+					 fprintf(stderr, "error: invalid firewall mode (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_PCAP_FILTER:
+				 if(!parse_result_list(optarg, &config.pcap_filter)) {
+					 fprintf(stderr, "error: invalid result list (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_PCAPNG:
+				 pcap_format = PCAP_FORMAT_PCAPNG;
+				 break;
+			case OPT_PCAP_ROTATE_SIZE:
+				 pcap_rotate_size = strtoull(optarg, &endptr, 10) * 1024 * 1024;
+				 if(*endptr != '\0') {
+					 fprintf(stderr, "error: invalid pcap rotation size (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_PCAP_ROTATE_TIME:
+				 pcap_rotate_time = strtoul(optarg, &endptr, 10);
+				 if(*endptr != '\0') {
+					 fprintf(stderr, "error: invalid pcap rotation time (%s)\n", optarg);
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
+			case OPT_TRACE:
+				 trace_init(optarg);
+				 break;
+			case OPT_METRICS_FILE:
+				 metrics->set_textfile(optarg);
+				 break;
+			case OPT_METRICS_LISTEN:
+				 if(!metrics->set_listen(optarg)) {
+					 exit(EXIT_FAILURE);
+				 }
+				 break;
 			case 'h':
 				usage(argv[0]);
 				exit(EXIT_SUCCESS);
@@ -255,22 +633,30 @@ int main(int argc, char** argv) {
 		capability_check();
 	}
 
-	linux_firewall_init(config);
+	linux_firewall_init(config, true);
 
+	if(priority_file != "") {
+		PrioritySubnetList* priority = new PrioritySubnetList();
+		if(!priority->load_scores(priority_file.c_str())) {
+			exit(EXIT_FAILURE);
+		}
+		config.subnets = priority;
 #ifdef HAVE_LIBCPERM
-	if(config.random) {
+	} else if(config.random) {
 		config.subnets = new RandomSubnetList();
+#endif /* HAVE_LIBCPERM */
 	} else {
 		config.subnets = new SubnetList();
 	}
-#else
-	config.subnets = new SubnetList();
-#endif /* HAVE_LIBCPERM */
 
 	config.exclude_list = new SubnetList();
 
 	if(config.pcap_file != "") {
-		OpenPcapDumper(DLT_RAW, config.pcap_file, config.pcap_handle, config.pcap_dumper);
+		config.pcap = new PcapWriter(config.pcap_file, pcap_format);
+		config.pcap->set_rotation(pcap_rotate_size, pcap_rotate_time);
+		if(!config.pcap->start()) {
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	/* Add subnets from input files */
@@ -299,54 +685,81 @@ int main(int argc, char** argv) {
 #endif
 	}
 
-	/* Spawn worker threads (if needed) and start scanning */
-	int spawn_delay = config.timeout * 1000000 / config.max_threads;
-	for(int i = 1; i < config.max_threads; i++) {
-		pthread_create(&tid, NULL, (void* (*)(void*))scanner, (void*)&config);
-		for(list<Output*>::iterator iter = config.outputs.begin(); iter != config.outputs.end(); iter++) {
-			(*iter)->output_message("Starting thread %d/%d...", i, config.max_threads);
+	if(incremental && store_file == "") {
+		fprintf(stderr, "error: --incremental needs a result store (--store)\n");
+		exit(EXIT_FAILURE);
+	}
+	if(store_file != "") {
+		config.store = new ResultStore(store_file);
+		if(!config.store->load()) {
+			exit(EXIT_FAILURE);
+		}
+		if(incremental) {
+			config.store->set_incremental(stale_after * 86400);
 		}
-		threads.push_back(tid);
-		usleep(spawn_delay);
+		config.outputs.push_back(new OutputStore(&config, config.store));
 	}
-	for(list<Output*>::iterator iter = config.outputs.begin(); iter != config.outputs.end(); iter++) {
-		(*iter)->output_message("");
+
+	if(adaptive) {
+		config.prefixes = new PrefixTracker(adaptive_threshold, adaptive_sample);
+	}
+	if(unreachable_skip) {
+		config.unreachable = new UnreachableCache(unreachable_threshold, unreachable_sample);
 	}
-	
-	scanner(&config);
 
-	/* Clean up threads */
-	while(threads.size() > 0) {
-		tid = *threads.begin();
-		threads.pop_front();
-		pthread_join(tid, NULL);
+	/* Positions are taken from the target list before anything is scanned */
+	if(retry_passes > 0) {
+		config.retry = new RetryPass(config.subnets, retry_passes, retry_delay);
 	}
 
+	scanner_init(&config);
+
+	config.writer = new OutputWriter(&config);
+	config.writer->start();
+	metrics->start();
+
+	bool ok = scanner_run(&config);
+
+	metrics->stop();
+	delete metrics;
+
+	/* Write out any results still queued before the outputs are closed */
+	config.writer->stop();
+	delete config.writer;
+	delete config.ports;
+	delete config.signatures;
+
+	if(config.prefixes && tarpit_ranges_file != "") {
+		config.prefixes->write_report(tarpit_ranges_file.c_str());
+	}
+
+	trace_dump();
+
 	for(list<Output*>::iterator iter = config.outputs.begin(); iter != config.outputs.end(); iter++) {
+		if((*iter)->output_failed()) {
+			ok = false;
+		}
 		delete (*iter);
 	}
 
 	linux_firewall_clear(config);
 
-	LOG_DEBUG("Total Scanned Hosts: %u\n", config.total_scans);
-	LOG_DEBUG("Total Responding Hosts: %u (%.2f%%)\n", config.total_hits,
-			config.total_hits/(double)config.total_scans * 100);
-	LOG_DEBUG("Total Tarpit Hosts: %u (%.2f%%)\n", config.total_tarpits,
-			config.total_tarpits/(double)config.total_scans * 100);
-	LOG_DEBUG("Total LaBrea Hosts: %u (%.2f%%)\n", config.total_labrea,
-			config.total_labrea/(double)config.total_scans * 100);
-	LOG_DEBUG("Total iptables Hosts: %u (%.2f%%)\n", config.total_iptables,
-			config.total_iptables/(double)config.total_scans * 100);
-	LOG_DEBUG("Total Excluded Hosts: %u\n", config.total_excluded);
-
-	pthread_mutex_destroy(&config.pcap_lock);
+	if(config.verbose) {
+		print_summary(config);
+	}
+	delete config.prefixes;
+	delete config.store;
+	delete config.retry;
+	delete config.unreachable;
+
 	pthread_mutex_destroy(&config.global_lock);
 
-	if(config.pcap_file != "") {
-		ClosePcapDumper(config.pcap_handle, config.pcap_dumper);
+	if(config.pcap) {
+		config.pcap->stop();
+		delete config.pcap;
 	}
 
 	delete config.subnets;
 	
-	return 0;
+	return ok ? 0 : EXIT_FAILURE;
 }
@@ -26,10 +26,11 @@
 #include <pthread.h>
 #include <string>
 #include <list>
-#include <pcap.h>
+#include <vector>
 
 #include "subnet_list.h"
 #include "random.h"
+#include "stats.h"
 
 #define LOG_OUT(level, format, ...)
 //#define LOG_OUT(level, format, ...) fprintf(stderr, level format, ##__VA_ARGS__);
@@ -40,6 +41,20 @@
 using namespace std;
 
 class Output;
+class OutputWriter;
+class PcapWriter;
+class PortAllocator;
+class SignatureTable;
+class PrefixTracker;
+class ResultStore;
+class RetryPass;
+class UnreachableCache;
+struct LinuxFirewall;
+
+enum FirewallMode {	FIREWALL_AUTO,
+					FIREWALL_NFTABLES,
+					FIREWALL_IPTABLES,
+					FIREWALL_NONE };
 
 struct DegreaserConfig {
 	string device;
@@ -56,32 +71,36 @@ struct DegreaserConfig {
 	bool dry_run;
 	bool fast_scan;
 	bool exclude_rfc6890;
-	uint16_t src_port_min;
+	uint16_t src_port_min;		/* Source port window, 0 to pick one below the ephemeral range */
 	uint16_t src_port_max;
+	PortAllocator* ports;
+	SignatureTable* signatures;	/* NULL unless single-probe classification is on */
+	uint8_t signature_threshold;
+	PrefixTracker* prefixes;	/* NULL unless adaptive scanning is on */
+	ResultStore* store;			/* NULL unless --store was given */
+	RetryPass* retry;			/* NULL unless --retry-passes was given */
+	UnreachableCache* unreachable;	/* NULL unless --unreachable-skip was given */
 	bool random;
+	FirewallMode firewall;
+	LinuxFirewall* firewall_state;	/* NULL unless rules are installed */
 
-	uint32_t total_scans;
-	uint32_t total_hits;
-	uint32_t total_tarpits;
-	uint32_t total_labrea;
-	uint32_t total_iptables;
-	uint32_t total_delude;
-	uint32_t total_excluded;
-	uint32_t total_errors;
-	uint32_t total_real;
-	uint32_t total_rejecting;
+	bool event_engine;			/* Event engine instead of a thread per scan */
+	uint32_t max_inflight;		/* Scans in flight per event engine */
+	vector<int> cpus;			/* CPUs to pin workers to, empty for none */
+
+	StatsRegistry stats;
 
 	SubnetList* subnets;
 	SubnetList* exclude_list;
 
 	list<Output*> outputs;
+	OutputWriter* writer;
 
 	pthread_mutex_t global_lock;
-	pthread_mutex_t pcap_lock;
 
 	string pcap_file;
-	pcap_t* pcap_handle;
-	pcap_dumper_t* pcap_dumper;
+	PcapWriter* pcap;
+	uint32_t pcap_filter;		/* SCAN_RESULT_BIT mask of results to capture, 0 for all */
 };
 
 
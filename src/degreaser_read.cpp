@@ -0,0 +1,194 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+/* degreaser-read: converts binary results files written with --binary-output
+   to CSV or newline-delimited JSON. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "scan_record.h"
+#include "output/binary_format.h"
+
+enum ReadFormat { FORMAT_CSV, FORMAT_JSON };
+
+static struct option long_options[] = {
+	{"json",			no_argument,		0,	'j'},
+	{"responsive",		no_argument,		0,	'r'},
+	{"help",			no_argument,		0,	'h'},
+	{NULL,				0,					0,	0}
+};
+
+static void usage(char* prog) {
+	fprintf(stderr, "Usage: %s [OPTIONS]... [FILES]...\n", prog);
+	fprintf(stderr, "Convert degreaser binary results files to text.\n"
+	                "  -j, --json                 Write newline-delimited JSON instead of CSV.\n"
+	                "  -r, --responsive           Skip hosts that did not respond.\n"
+	                "  -h, --help                 Show this message.\n");
+}
+
+static void print_record(const ScanRecord* r, ReadFormat format) {
+	char addr[INET_ADDRSTRLEN];
+	char router[INET_ADDRSTRLEN];
+	char flags[5];
+	char opts[5];
+	char send_opts[5];
+
+	inet_ntop(AF_INET, &r->addr, addr, sizeof(addr));
+	scan_flags_to_string(r->flags, flags);
+	scan_options_to_string(r->options, opts);
+
+	if(format == FORMAT_JSON) {
+		inet_ntop(AF_INET, &r->icmp_router, router, sizeof(router));
+		scan_options_to_string(r->send_options, send_opts);
+		printf("{\"addr\":\"%s\",\"result\":\"%s\",\"response_time\":%u,\"window_size\":%u,"
+				"\"flags\":\"%s\",\"options\":\"%s\",\"timestamp\":%u,\"src_port\":%u,\"dst_port\":%u,"
+				"\"confidence\":%u,\"ttl\":%u,\"send_options\":\"%s\",\"icmp_router\":\"%s\",\"icmp_code\":%u}\n",
+				addr, scan_result_to_string(r->result), r->response_time, r->window_size,
+				flags, opts, r->timestamp, r->src_port, r->dst_port, r->confidence, r->ttl,
+				send_opts, router, r->icmp_code);
+	} else {
+		printf("%s,%s,%u,%u,%s,%s,%u\n",
+				addr, scan_result_to_string(r->result), r->response_time, r->window_size,
+				flags, opts, r->timestamp);
+	}
+}
+
+static bool read_file(const char* fn, ReadFormat format, bool responsive) {
+	struct stat st;
+	const BinaryFileHeader* header;
+	const uint8_t* records;
+	uint64_t count;
+	uint32_t size;
+	ScanRecord r;
+
+	int fd = open(fn, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "error: failed to open '%s'. Reason: %s\n", fn, strerror(errno));
+		return false;
+	}
+
+	if(0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(BinaryFileHeader)) {
+		fprintf(stderr, "error: '%s' is not a degreaser binary file\n", fn);
+		close(fd);
+		return false;
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "error: failed to map '%s'. Reason: %s\n", fn, strerror(errno));
+		return false;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	header = (const BinaryFileHeader*)map;
+	if(0 != memcmp(header->magic, BINARY_FORMAT_MAGIC, sizeof(BINARY_FORMAT_MAGIC)) ||
+			header->byte_order != BINARY_FORMAT_BYTE_ORDER ||
+			!((header->version == BINARY_FORMAT_VERSION && header->record_size == sizeof(ScanRecord)) ||
+			  (header->version == 1 && header->record_size == BINARY_FORMAT_V1_RECORD_SIZE))) {
+		fprintf(stderr, "error: '%s' is not a compatible degreaser binary file\n", fn);
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	/* Records are contiguous after the header. An unfinished file has no
+	   index, so fall back to however many complete records are present. */
+	records = (const uint8_t*)(header + 1);
+	size = header->record_size;
+	if(header->index_offset >= sizeof(BinaryFileHeader) && header->index_offset <= (uint64_t)st.st_size) {
+		/* Never trust the count beyond the records that fit before the index */
+		count = header->record_count;
+		if(count > (header->index_offset - sizeof(BinaryFileHeader)) / size) {
+			fprintf(stderr, "warning: '%s' has a corrupt record count, reading the records before the index\n", fn);
+			count = (header->index_offset - sizeof(BinaryFileHeader)) / size;
+		}
+	} else {
+		fprintf(stderr, "warning: '%s' was not closed cleanly, reading all complete records\n", fn);
+		count = (st.st_size - sizeof(BinaryFileHeader)) / size;
+	}
+
+	/* Older records are shorter; the fields they lack read as zero */
+	memset(&r, 0, sizeof(r));
+	for(uint64_t i = 0; i < count; i++) {
+		memcpy(&r, records + i * size, size);
+		if(responsive && r.result <= NO_RESPONSE) {
+			continue;
+		}
+		print_record(&r, format);
+	}
+
+	munmap(map, st.st_size);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	ReadFormat format = FORMAT_CSV;
+	bool responsive = false;
+	bool ok = true;
+	int c;
+	int opt_index;
+
+	while(-1 != (c = getopt_long(argc, argv, "jrh", long_options, &opt_index))) {
+		switch(c) {
+			case 'j':
+				format = FORMAT_JSON;
+				break;
+			case 'r':
+				responsive = true;
+				break;
+			case 'h':
+				usage(argv[0]);
+				exit(EXIT_SUCCESS);
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if(optind >= argc) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Output is fully buffered; this tool is usually piped into something else */
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+	if(format == FORMAT_CSV) {
+		printf("IP Address,Scan Result,Response Time, Window Size, TCP Flags, TCP Options, Timestamp\n");
+	}
+
+	for(int i = optind; i < argc; i++) {
+		ok &= read_file(argv[i], format, responsive);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,701 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+#include "engine.h"
+#include "scanner.h"
+#include "port_allocator.h"
+#include "trace.h"
+#include "probes.h"
+#include "pcap_writer.h"
+#include "cpu_affinity.h"
+
+#define RECV_BUFFER_SIZE	(4 * 1024 * 1024)
+#define RECV_BATCH			256
+#define RETRY_POLL_MS		100
+#define DROP_CHECK_US		1000000
+
+/* Send errors are reported once per process and counted after that */
+static bool send_error_reported = false;
+
+static uint64_t engine_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+ScanEngine::ScanEngine(DegreaserConfig* c, uint32_t m, uint16_t min, uint16_t max) : config(c), port_min(min), port_max(max) {
+	send_fd = recv_fd = epoll_fd = -1;
+	src_addr = 0;
+	inflight = 0;
+	now = 0;
+	drops_checked = 0;
+	targets_done = false;
+	timer_head = timer_tail = NULL;
+	timeout_us = (uint64_t)config->timeout * 1000000;
+	max_attempts = config->retries > 0 ? config->retries : 1;
+	syn_attempts = config->retry ? 1 : max_attempts;
+
+	/* Every probe in flight holds a source port */
+	ports = new PortAllocator(port_min, port_max);
+	max_inflight = m < ports->size() ? m : ports->size();
+
+	probes = new Probe[max_inflight];
+	free_list = NULL;
+	for(uint32_t i = 0; i < max_inflight; i++) {
+		probes[i].scan = new Scan(*config, 0, 0xffffffff);
+		probes[i].state = PROBE_FREE;
+		probes[i].next = free_list;
+		free_list = &probes[i];
+	}
+
+	by_port = new Probe*[ports->size()];
+	memset(by_port, 0, ports->size() * sizeof(Probe*));
+}
+
+ScanEngine::~ScanEngine() {
+	if(send_fd != -1) close(send_fd);
+	if(recv_fd != -1) close(recv_fd);
+	if(epoll_fd != -1) close(epoll_fd);
+	for(uint32_t i = 0; i < max_inflight; i++) {
+		delete probes[i].scan;
+	}
+	delete[] probes;
+	delete[] by_port;
+	delete ports;
+}
+
+bool ScanEngine::open() {
+	struct sockaddr_ll sll;
+	struct epoll_event ev;
+	int size = RECV_BUFFER_SIZE;
+
+	if(!find_source_address()) {
+		return false;
+	}
+
+	if(config->dry_run) {
+		return true;
+	}
+
+	if(-1 == (send_fd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW))) {
+		fprintf(stderr, "error: failed to open raw socket. Reason: %s\n", strerror(errno));
+		return false;
+	}
+
+	/* Replies arrive at the packet socket before the firewall drops them */
+	if(-1 == (recv_fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK, htons(ETH_P_IP)))) {
+		fprintf(stderr, "error: failed to open packet socket. Reason: %s\n", strerror(errno));
+		return false;
+	}
+	setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	if(!attach_filter()) {
+		return false;
+	}
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_IP);
+	sll.sll_ifindex = config->device != "" ? if_nametoindex(config->device.c_str()) : 0;
+	if(-1 == bind(recv_fd, (struct sockaddr*)&sll, sizeof(sll))) {
+		fprintf(stderr, "error: failed to bind packet socket to '%s'. Reason: %s\n", config->device.c_str(), strerror(errno));
+		return false;
+	}
+
+	if(-1 == (epoll_fd = epoll_create(1))) {
+		fprintf(stderr, "error: epoll_create failed. Reason: %s\n", strerror(errno));
+		return false;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = recv_fd;
+	if(-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, recv_fd, &ev)) {
+		fprintf(stderr, "error: epoll_ctl failed. Reason: %s\n", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/* Address of the scan device, or of the interface the default route uses */
+bool ScanEngine::find_source_address() {
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if(fd == -1) {
+		fprintf(stderr, "error: failed to open socket. Reason: %s\n", strerror(errno));
+		return false;
+	}
+
+	if(config->device != "") {
+		struct ifreq ifr;
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, config->device.c_str(), IFNAMSIZ - 1);
+		ifr.ifr_addr.sa_family = AF_INET;
+		if(-1 == ioctl(fd, SIOCGIFADDR, &ifr)) {
+			fprintf(stderr, "error: failed to get the address of '%s'. Reason: %s\n", config->device.c_str(), strerror(errno));
+			close(fd);
+			return false;
+		}
+		src_addr = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr.s_addr;
+	} else {
+		/* Connecting a UDP socket sends nothing, but picks the route */
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(53);
+		sin.sin_addr.s_addr = inet_addr("192.0.2.1");
+		if(-1 == connect(fd, (struct sockaddr*)&sin, sizeof(sin)) || -1 == getsockname(fd, (struct sockaddr*)&sin, &len)) {
+			fprintf(stderr, "error: failed to find a source address. Use -d to pick a device.\n");
+			close(fd);
+			return false;
+		}
+		src_addr = sin.sin_addr.s_addr;
+	}
+
+	close(fd);
+	return true;
+}
+
+/* Accept ICMP, and TCP to our source port range. The socket delivers
+   packets from the IP header on. */
+bool ScanEngine::attach_filter() {
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 5, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, 0, 5),
+		BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+		BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, port_min, 0, 2),
+		BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, port_max, 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, 0xffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if(-1 == setsockopt(recv_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog))) {
+		fprintf(stderr, "error: failed to attach socket filter. Reason: %s\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/* Hand each reply to the worker owning the port it was sent to: the TCP
+   destination port, or the source port of the probe an ICMP error quotes.
+   Worker i owns the i-th slice of the source port window and the last
+   worker also takes the remainder, which the clamp to workers - 1 covers. */
+bool ScanEngine::join_fanout(uint16_t group, uint16_t workers) {
+#ifdef PACKET_FANOUT_CBPF
+	uint32_t slice = (config->src_port_max - config->src_port_min + 1) / workers;
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, 0, 2),
+		BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+		BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0),
+		BPF_STMT(BPF_LD | BPF_H | BPF_IND, 8 + 20),
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, config->src_port_min, 0, 5),
+		BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, config->src_port_min),
+		BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, slice),
+		BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, workers, 0, 1),
+		BPF_STMT(BPF_LD | BPF_IMM, workers - 1u),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+	int arg = group | (PACKET_FANOUT_CBPF << 16);
+
+	if(recv_fd == -1) {
+		return true;
+	}
+
+	if(-1 == setsockopt(recv_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg))) {
+		fprintf(stderr, "error: failed to join packet fanout group. Reason: %s\n", strerror(errno));
+		return false;
+	}
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if(-1 == setsockopt(recv_fd, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog))) {
+		fprintf(stderr, "error: failed to set packet fanout program. Reason: %s\n", strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	fprintf(stderr, "error: multiple workers need PACKET_FANOUT_CBPF (Linux 4.2 or later)\n");
+	return false;
+#endif
+}
+
+bool ScanEngine::run() {
+	struct epoll_event ev;
+	bool ok = true;
+
+	config->stats.attach();
+	trace_attach("engine");
+
+	for(;;) {
+		now = engine_now();
+		start_probes();
+		if(inflight == 0 && targets_done) {
+			break;
+		}
+
+		/* Sleep until a reply arrives or the oldest wait times out */
+		int wait = -1;
+		if(timer_head) {
+			wait = timer_head->deadline > now ? (timer_head->deadline - now + 999) / 1000 : 0;
+		} else if(!targets_done) {
+			/* Nothing in flight while waiting for the next retry pass */
+			wait = RETRY_POLL_MS;
+		}
+		if(config->pcap) {
+			config->pcap->flush_thread_if_old();
+		}
+		if(recv_fd != -1) {
+			if(-1 == epoll_wait(epoll_fd, &ev, 1, wait) && errno != EINTR) {
+				fprintf(stderr, "error: epoll_wait failed. Reason: %s\n", strerror(errno));
+				ok = false;
+				break;
+			}
+		}
+
+		now = engine_now();
+		receive();
+		expire();
+		if(now - drops_checked >= DROP_CHECK_US) {
+			count_drops();
+		}
+	}
+	count_drops();
+
+	if(config->pcap) {
+		config->pcap->flush_thread();
+	}
+	return ok;
+}
+
+/* Start new targets until the in-flight limit is reached */
+void ScanEngine::start_probes() {
+	uint32_t addr;
+
+	while(!targets_done && free_list) {
+		if(0 == (addr = scanner_next_target(config, &targets_done))) {
+			break;
+		}
+
+		Probe* p = free_list;
+		free_list = p->next;
+		p->prev = p->next = NULL;
+
+		p->scan->reset(addr, 0xffffffff);
+		p->port = ports->acquire();
+		p->attempts = 0;
+		p->sent_time = now;
+		by_port[p->port - port_min] = p;
+		inflight++;
+		STATS_INC(in_flight);
+
+		p->scan->begin(config->port, p->port);
+		p->state = PROBE_SYN_WAIT;
+		send(p, SCAN_PACKET_SYN);
+		if(config->dry_run) {
+			p->attempts = syn_attempts;
+			advance(p, NULL);
+		}
+	}
+}
+
+void ScanEngine::send(Probe* p, ScanPacket type) {
+	struct sockaddr_in sin;
+
+	TRACE_BEGIN(TRACE_BUILD_PACKET);
+	size_t len = p->scan->build_raw(type, src_addr, packet, sizeof(packet));
+	TRACE_END(TRACE_BUILD_PACKET);
+
+	p->scan->dump_raw(packet, len);
+	p->attempts++;
+	if(config->dry_run) {
+		return;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = p->scan->ia.s_addr;
+
+	DEGREASER_PROBE3(probe_send, sin.sin_addr.s_addr, p->port, config->port);
+	TRACE_BEGIN(TRACE_SEND);
+	ssize_t sent = sendto(send_fd, packet, len, 0, (struct sockaddr*)&sin, sizeof(sin));
+	int err = errno;
+	TRACE_END(TRACE_SEND);
+	if(sent == -1) {
+		/* The probe then times out as NO_RESPONSE, so say why, once */
+		STATS_INC(send_errors);
+		if(!__atomic_exchange_n(&send_error_reported, true, __ATOMIC_RELAXED)) {
+			fprintf(stderr, "warning: failed to send a probe, further send errors are only counted. Reason: %s\n", strerror(err));
+		}
+	} else {
+		STATS_INC(packets_sent);
+	}
+
+	if(type != SCAN_PACKET_RST) {
+		arm(p);
+	}
+}
+
+void ScanEngine::receive() {
+	uint8_t buf[2048];
+	struct sockaddr_ll sll;
+	socklen_t len;
+	ReplyInfo reply;
+
+	if(recv_fd == -1) {
+		return;
+	}
+
+	for(int i = 0; i < RECV_BATCH; i++) {
+		len = sizeof(sll);
+		ssize_t n = recvfrom(recv_fd, buf, sizeof(buf), 0, (struct sockaddr*)&sll, &len);
+		if(n < 0) {
+			break;
+		}
+
+		/* Our own probes go past the packet socket too */
+		if(sll.sll_pkttype == PACKET_OUTGOING) {
+			continue;
+		}
+
+		TRACE_BEGIN(TRACE_PARSE);
+		bool parsed = reply_parse_ip(buf, n, &reply);
+		TRACE_END(TRACE_PARSE);
+		if(!parsed) {
+			continue;
+		}
+
+		Probe* p = match(reply);
+		if(!p) {
+			continue;
+		}
+
+		STATS_INC(packets_recv);
+		DEGREASER_PROBE3(reply_recv, p->scan->ia.s_addr, p->port, now - p->sent_time);
+		p->scan->dump_raw(buf, n);
+		advance(p, &reply);
+	}
+}
+
+/* Find the probe a reply belongs to: TCP from the target to one of our
+   ports, or an ICMP error quoting one of our probes */
+ScanEngine::Probe* ScanEngine::match(const ReplyInfo& reply) {
+	uint16_t port;
+	uint32_t target;
+
+	if(reply.protocol == IPPROTO_TCP) {
+		if(reply.src_port != config->port) {
+			return NULL;
+		}
+		port = reply.dst_port;
+		target = reply.src_addr;
+	} else if(reply.protocol == IPPROTO_ICMP && reply.icmp_orig_dst != 0) {
+		if(reply.icmp_orig_dst_port != config->port) {
+			return NULL;
+		}
+		port = reply.icmp_orig_src_port;
+		target = reply.icmp_orig_dst;
+	} else {
+		return NULL;
+	}
+
+	if(port < port_min || port > port_max) {
+		return NULL;
+	}
+	Probe* p = by_port[port - port_min];
+	if(!p || p->scan->ia.s_addr != target) {
+		return NULL;
+	}
+	return p;
+}
+
+/* Handle waits that ran out, oldest first */
+/* Replies the kernel dropped because the receive socket's buffer was full.
+   Reading the statistics resets them, so each read adds what is new. */
+void ScanEngine::count_drops() {
+	struct tpacket_stats st;
+	socklen_t len = sizeof(st);
+
+	drops_checked = now;
+	if(recv_fd != -1 && 0 == getsockopt(recv_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len)) {
+		STATS_ADD(recv_dropped, st.tp_drops);
+	}
+}
+
+void ScanEngine::expire() {
+	while(timer_head && timer_head->deadline <= now) {
+		Probe* p = timer_head;
+		disarm(p);
+
+		if(p->attempts < (p->state == PROBE_SYN_WAIT ? syn_attempts : max_attempts)) {
+			/* Send the same packet of the sequence again */
+			switch(p->state) {
+				case PROBE_SYN_WAIT:	send(p, SCAN_PACKET_SYN); break;
+				case PROBE_ACK_WAIT:	send(p, SCAN_PACKET_ACK); break;
+				case PROBE_DATA_WAIT:	send(p, SCAN_PACKET_DATA); break;
+			}
+		} else {
+			if(p->state == PROBE_SYN_WAIT && !config->dry_run) {
+				DEGREASER_PROBE2(reply_timeout, p->scan->ia.s_addr, p->port);
+			}
+			advance(p, NULL);
+		}
+	}
+}
+
+/* Move a probe on after a reply, or after its last attempt timed out */
+void ScanEngine::advance(Probe* p, const ReplyInfo* reply) {
+	bool done = false;
+
+	disarm(p);
+
+	switch(p->state) {
+		case PROBE_SYN_WAIT:
+			if(reply) {
+				p->scan->response_time = now - p->sent_time;
+			}
+			done = p->scan->on_syn_reply(reply);
+			if(!done) {
+				p->state = PROBE_ACK_WAIT;
+				p->attempts = 0;
+				send(p, SCAN_PACKET_ACK);
+			}
+			break;
+		case PROBE_ACK_WAIT:
+			done = p->scan->on_ack_reply(reply);
+			if(!done) {
+				p->state = PROBE_DATA_WAIT;
+				p->attempts = 0;
+				send(p, SCAN_PACKET_DATA);
+			}
+			break;
+		case PROBE_DATA_WAIT:
+			p->scan->on_data_reply(reply);
+			done = true;
+			break;
+	}
+
+	if(done) {
+		complete(p);
+	}
+}
+
+void ScanEngine::complete(Probe* p) {
+	if(!config->dry_run) {
+		send(p, SCAN_PACKET_RST);
+	}
+	p->scan->finish();
+
+	/* The RST has gone out, so nothing more is expected on this port */
+	by_port[p->port - port_min] = NULL;
+	ports->release(p->port);
+	inflight--;
+	STATS_DEC(in_flight);
+
+	scanner_complete(config, p->scan);
+
+	p->state = PROBE_FREE;
+	p->next = free_list;
+	free_list = p;
+}
+
+/* Every wait has the same length, so appending keeps the list in deadline order */
+void ScanEngine::arm(Probe* p) {
+	p->deadline = now + timeout_us;
+	p->prev = timer_tail;
+	p->next = NULL;
+	if(timer_tail) {
+		timer_tail->next = p;
+	} else {
+		timer_head = p;
+	}
+	timer_tail = p;
+}
+
+void ScanEngine::disarm(Probe* p) {
+	if(p->prev) {
+		p->prev->next = p->next;
+	} else if(timer_head == p) {
+		timer_head = p->next;
+	} else {
+		return;
+	}
+	if(p->next) {
+		p->next->prev = p->prev;
+	} else {
+		timer_tail = p->prev;
+	}
+	p->prev = p->next = NULL;
+}
+
+/* Workers join the fanout group one at a time, in index order, and none
+   starts scanning until all have joined */
+struct FanoutOrder {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint16_t joined;
+	bool failed;
+};
+
+struct EngineWorker {
+	DegreaserConfig* config;
+	FanoutOrder* order;
+	uint32_t max_inflight;
+	uint16_t index;
+	uint16_t workers;
+	uint16_t group;
+	uint16_t port_min;
+	uint16_t port_max;
+	bool ok;
+};
+
+static void* engine_worker(void* arg) {
+	EngineWorker* w = (EngineWorker*)arg;
+	FanoutOrder* order = w->order;
+
+	/* Built on the pinned thread so the probe pool, port table and buffers
+	   are first touched, and so placed, on this core's memory node */
+	ScanEngine* engine = new ScanEngine(w->config, w->max_inflight, w->port_min, w->port_max);
+	bool ok = engine->open();
+
+	pthread_mutex_lock(&order->lock);
+	while(order->joined != w->index) {
+		pthread_cond_wait(&order->cond, &order->lock);
+	}
+	if(ok && !order->failed) {
+		ok = engine->join_fanout(w->group, w->workers);
+	}
+	if(!ok) {
+		order->failed = true;
+	}
+	order->joined++;
+	pthread_cond_broadcast(&order->cond);
+	while(order->joined != w->workers) {
+		pthread_cond_wait(&order->cond, &order->lock);
+	}
+	ok = !order->failed;
+	pthread_mutex_unlock(&order->lock);
+
+	if(ok) {
+		ok = engine->run();
+	}
+	delete engine;
+	w->ok = ok;
+	return NULL;
+}
+
+bool engine_run_workers(DegreaserConfig* config, const vector<int>& cpus, uint32_t max_inflight) {
+	uint16_t workers = cpus.size();
+	uint32_t slice = (config->src_port_max - config->src_port_min + 1) / workers;
+	vector<EngineWorker> work(workers);
+	vector<pthread_t> tids(workers);
+	FanoutOrder order;
+
+	pthread_mutex_init(&order.lock, NULL);
+	pthread_cond_init(&order.cond, NULL);
+	order.joined = 0;
+	order.failed = false;
+
+	/* Pin everything up front, so a bad CPU fails before any scanning */
+	vector<pthread_attr_t> attrs(workers);
+	for(uint16_t i = 0; i < workers; i++) {
+		pthread_attr_init(&attrs[i]);
+		if(!cpu_attr_pin(&attrs[i], cpus[i])) {
+			for(uint16_t j = 0; j <= i; j++) {
+				pthread_attr_destroy(&attrs[j]);
+			}
+			return false;
+		}
+	}
+
+	for(uint16_t i = 0; i < workers; i++) {
+		work[i].config = config;
+		work[i].order = &order;
+		work[i].max_inflight = max_inflight;
+		work[i].index = i;
+		work[i].workers = workers;
+		work[i].group = getpid() & 0xffff;
+		work[i].port_min = config->src_port_min + i * slice;
+		work[i].port_max = i == workers - 1 ? config->src_port_max : work[i].port_min + slice - 1;
+		work[i].ok = false;
+	}
+
+	/* Workers wait for each other to join the fanout group, so one that
+	   can't be started has to be stood in for */
+	uint16_t started = 0;
+	for(uint16_t i = 0; i < workers; i++) {
+		if(0 != pthread_create(&tids[i], &attrs[i], engine_worker, &work[i])) {
+			fprintf(stderr, "error: failed to start engine worker %u\n", i);
+			break;
+		}
+		started++;
+	}
+	if(started < workers) {
+		pthread_mutex_lock(&order.lock);
+		while(order.joined != started) {
+			pthread_cond_wait(&order.cond, &order.lock);
+		}
+		order.failed = true;
+		order.joined = workers;
+		pthread_cond_broadcast(&order.cond);
+		pthread_mutex_unlock(&order.lock);
+	}
+
+	bool ok = started == workers;
+	for(uint16_t i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+		ok = ok && work[i].ok;
+	}
+
+	for(uint16_t i = 0; i < workers; i++) {
+		pthread_attr_destroy(&attrs[i]);
+	}
+	pthread_cond_destroy(&order.cond);
+	pthread_mutex_destroy(&order.lock);
+
+	return ok && !order.failed;
+}
@@ -0,0 +1,126 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "degreaser.h"
+#include "reply_parser.h"
+#include "scan.h"
+#include "packet_builder.h"
+
+/* Event driven scan engine. Instead of a thread blocking in each stage of
+   a scan, every target in flight is a small state machine (waiting for the
+   SYN/ACK, the ACK reply or the data reply) advanced by replies and
+   timeouts from a single epoll loop. Packets are built in place and sent on
+   a raw socket; replies are read from a packet socket that only lets
+   through TCP to our source ports and ICMP. The classification itself is
+   the same Scan code used by the threaded scanner.
+
+   Replies are matched to targets by destination port, which the port
+   allocator keeps unique for every scan in flight. Every wait uses the same
+   timeout, so the pending timeouts form a FIFO ordered by deadline.
+
+   Each engine owns the source ports port_min-port_max. Several engines can
+   split the src_port_min-src_port_max window between them, with their
+   packet sockets joined in one fanout group that hands every reply to the
+   engine owning its port (see engine_run_workers). */
+class ScanEngine {
+	public:
+		ScanEngine(DegreaserConfig* config, uint32_t max_inflight, uint16_t port_min, uint16_t port_max);
+		~ScanEngine();
+
+		/* Open the sockets. Returns false (after printing why) on failure. */
+		bool open();
+
+		/* Join the fanout group shared by all workers. Members are numbered
+		   in the order they join, so worker i must join i-th. */
+		bool join_fanout(uint16_t group, uint16_t workers);
+
+		/* Scan until the targets run out and nothing is left in flight.
+		   Returns false (after printing why) if the event loop failed. */
+		bool run();
+
+	private:
+		enum ProbeState {	PROBE_FREE,
+							PROBE_SYN_WAIT,
+							PROBE_ACK_WAIT,
+							PROBE_DATA_WAIT };
+
+		struct Probe {
+			Scan* scan;				/* Owned by the probe, reset for each target */
+			uint64_t sent_time;		/* First SYN, for the response time */
+			uint64_t deadline;
+			uint16_t port;
+			uint8_t state;
+			uint8_t attempts;
+			Probe* prev;			/* Timeout list, or free list through next */
+			Probe* next;
+		};
+
+		void start_probes();
+		void receive();
+		void count_drops();
+		void expire();
+		void advance(Probe* p, const ReplyInfo* reply);
+		void send(Probe* p, ScanPacket type);
+		void arm(Probe* p);
+		void disarm(Probe* p);
+		void complete(Probe* p);
+		Probe* match(const ReplyInfo& reply);
+		bool find_source_address();
+		bool attach_filter();
+
+		DegreaserConfig* config;
+		PortAllocator* ports;
+		uint16_t port_min;
+		uint16_t port_max;
+		int send_fd;
+		int recv_fd;
+		int epoll_fd;
+		uint32_t src_addr;
+		uint32_t max_inflight;
+		uint32_t inflight;
+		uint8_t max_attempts;
+		uint8_t syn_attempts;		/* 1 when retry passes take care of the SYN */
+		uint64_t timeout_us;
+		uint64_t now;
+		uint64_t drops_checked;		/* When count_drops() last ran */
+		bool targets_done;
+
+		Probe* probes;
+		Probe* free_list;
+		Probe** by_port;			/* Indexed by port - port_min */
+		Probe* timer_head;
+		Probe* timer_tail;
+
+		uint8_t packet[PACKET_MAX_SIZE];
+};
+
+/* Run one engine per CPU in cpus, each pinned to its core and owning an
+   equal slice of the source port window. Returns when all have finished,
+   false if any worker could not be started or failed. */
+bool engine_run_workers(DegreaserConfig* config, const vector<int>& cpus, uint32_t max_inflight);
+
+#endif /* ENGINE_H */
@@ -0,0 +1,104 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define RELAXED_ADD(var, n) __atomic_store_n(&(var), __atomic_load_n(&(var), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED)
+
+void Histogram::clear() {
+	memset(this, 0, sizeof(*this));
+}
+
+uint32_t Histogram::bucket_index(uint32_t value) {
+	if(value < SUB_BUCKETS) {
+		return value;
+	}
+
+	uint32_t msb = 31 - __builtin_clz(value);
+	uint32_t shift = msb - (SUB_BUCKET_BITS - 1);
+	return SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + ((value >> shift) - HALF_BUCKETS);
+}
+
+/* Largest value that maps to the given bucket */
+uint32_t Histogram::bucket_high(uint32_t index) {
+	if(index < SUB_BUCKETS) {
+		return index;
+	}
+
+	uint32_t shift = (index - SUB_BUCKETS) / HALF_BUCKETS + 1;
+	uint32_t sub = (index - SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+	return ((uint64_t)(sub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint32_t value) {
+	RELAXED_ADD(buckets[bucket_index(value)], 1);
+	RELAXED_ADD(total, 1);
+	if(value > max_value) {
+		__atomic_store_n(&max_value, value, __ATOMIC_RELAXED);
+	}
+}
+
+void Histogram::merge(const Histogram& h) {
+	for(uint32_t i = 0; i < BUCKETS; i++) {
+		buckets[i] += __atomic_load_n(&h.buckets[i], __ATOMIC_RELAXED);
+	}
+	total += __atomic_load_n(&h.total, __ATOMIC_RELAXED);
+
+	uint32_t m = __atomic_load_n(&h.max_value, __ATOMIC_RELAXED);
+	if(m > max_value) {
+		max_value = m;
+	}
+}
+
+uint64_t Histogram::count() const {
+	return total;
+}
+
+uint32_t Histogram::max() const {
+	return max_value;
+}
+
+/* p is a fraction between 0 and 1 */
+uint32_t Histogram::percentile(double p) const {
+	uint64_t seen = 0;
+
+	if(total == 0) {
+		return 0;
+	}
+
+	uint64_t target = (uint64_t)(p * total + 0.5);
+	if(target < 1) {
+		target = 1;
+	}
+
+	for(uint32_t i = 0; i < BUCKETS; i++) {
+		seen += buckets[i];
+		if(seen >= target) {
+			uint32_t high = bucket_high(i);
+			return high < max_value ? high : max_value;
+		}
+	}
+
+	return max_value;
+}
@@ -0,0 +1,58 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log-bucketed histogram of 32 bit values, in the style of HdrHistogram.
+   Values below 32 get exact buckets; above that every power of two is split
+   into 16 linear sub-buckets, which keeps the relative error of any
+   reported percentile under about 6% with a fixed 464 buckets.
+
+   record() may only be called by the thread that owns the histogram, but
+   other threads may merge() it at any time. */
+class Histogram {
+	public:
+		const static uint32_t SUB_BUCKET_BITS = 5;
+		const static uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		const static uint32_t HALF_BUCKETS = SUB_BUCKETS / 2;
+		const static uint32_t BUCKETS = SUB_BUCKETS + (32 - SUB_BUCKET_BITS) * HALF_BUCKETS;
+
+		void clear();
+		void record(uint32_t value);
+		void merge(const Histogram& h);
+
+		uint64_t count() const;
+		uint32_t max() const;
+		uint32_t percentile(double p) const;
+
+	private:
+		uint64_t buckets[BUCKETS];
+		uint64_t total;
+		uint32_t max_value;
+
+		static uint32_t bucket_index(uint32_t value);
+		static uint32_t bucket_high(uint32_t index);
+};
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,248 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+
+#include <list>
+#include <utility>
+
+#include "libdegreaser.h"
+#include "degreaser.h"
+#include "scan.h"
+#include "scanner.h"
+#include "output.h"
+#include "output_writer.h"
+#include "port_allocator.h"
+#include "signature.h"
+#include "linux_firewall.h"
+#include "output/output_callback.h"
+
+struct Degreaser::Impl {
+	DegreaserConfig config;
+	list<pair<uint32_t, uint8_t> > targets;		/* Host byte order */
+	DegreaserResultCallback callback;
+	void* user;
+	bool handle_signals;
+	bool ran;
+};
+
+/* Split "a.b.c.d/len" or "a.b.c.d" into a host order address and prefix */
+static bool parse_cidr(const std::string& cidr, uint32_t* addr, uint8_t* prefix) {
+	std::string host = cidr;
+	struct in_addr ia;
+	char* endptr;
+
+	*prefix = 32;
+	size_t slash = cidr.find('/');
+	if(slash != std::string::npos) {
+		long int len = strtol(cidr.c_str() + slash + 1, &endptr, 10);
+		if(*endptr != '\0' || endptr == cidr.c_str() + slash + 1 || len < 0 || len > 32) {
+			return false;
+		}
+		*prefix = len;
+		host = cidr.substr(0, slash);
+	}
+
+	if(1 != inet_pton(AF_INET, host.c_str(), &ia)) {
+		return false;
+	}
+	*addr = ntohl(ia.s_addr);
+	return true;
+}
+
+Degreaser::Degreaser() {
+	impl = new Impl();
+	scanner_defaults(&impl->config);
+	impl->config.verbose = 0;
+	impl->config.exclude_list = new SubnetList();
+	impl->callback = NULL;
+	impl->user = NULL;
+	impl->handle_signals = false;
+	impl->ran = false;
+}
+
+Degreaser::~Degreaser() {
+	DegreaserConfig& config = impl->config;
+
+	linux_firewall_clear(config);
+	delete config.subnets;
+	delete config.exclude_list;
+	delete config.ports;
+	delete config.signatures;
+	pthread_mutex_destroy(&config.global_lock);
+	delete impl;
+}
+
+void Degreaser::set_device(const std::string& device) {
+	impl->config.device = device;
+}
+
+void Degreaser::set_port(uint16_t port) {
+	impl->config.port = port;
+}
+
+void Degreaser::set_window_threshold(uint32_t threshold) {
+	impl->config.win_threshold = threshold;
+}
+
+void Degreaser::set_timeout(uint16_t seconds) {
+	impl->config.timeout = seconds;
+}
+
+void Degreaser::set_threads(uint16_t threads) {
+	impl->config.max_threads = threads ? threads : 1;
+	impl->config.event_engine = false;
+}
+
+void Degreaser::set_event_engine(uint32_t max_inflight) {
+	impl->config.event_engine = true;
+	impl->config.max_inflight = max_inflight ? max_inflight : 1;
+}
+
+void Degreaser::set_cpus(const std::vector<int>& cpus) {
+	impl->config.cpus = cpus;
+}
+
+void Degreaser::set_source_ports(uint16_t min, uint16_t max) {
+	impl->config.src_port_min = min;
+	impl->config.src_port_max = max;
+}
+
+void Degreaser::set_fast_scan(bool fast) {
+	impl->config.fast_scan = fast;
+}
+
+void Degreaser::set_single_probe(bool single_probe) {
+	DegreaserConfig& config = impl->config;
+
+	if(single_probe && !config.signatures) {
+		config.signatures = new SignatureTable();
+		config.signatures->add_defaults();
+	} else if(!single_probe) {
+		delete config.signatures;
+		config.signatures = NULL;
+	}
+}
+
+void Degreaser::set_random(bool random) {
+	impl->config.random = random;
+}
+
+void Degreaser::set_dry_run(bool dry_run) {
+	impl->config.dry_run = dry_run;
+}
+
+void Degreaser::set_exclude_rfc6890(bool exclude) {
+	impl->config.exclude_rfc6890 = exclude;
+}
+
+void Degreaser::set_all_results(bool all) {
+	impl->config.all_scans = all;
+}
+
+void Degreaser::set_handle_signals(bool handle) {
+	impl->handle_signals = handle;
+}
+
+bool Degreaser::add_target(const std::string& cidr) {
+	uint32_t addr;
+	uint8_t prefix;
+
+	if(!parse_cidr(cidr, &addr, &prefix)) {
+		return false;
+	}
+	impl->targets.push_back(make_pair(addr, prefix));
+	return true;
+}
+
+void Degreaser::add_target(uint32_t addr, uint8_t prefix) {
+	impl->targets.push_back(make_pair(ntohl(addr), prefix));
+}
+
+bool Degreaser::add_exclude(const std::string& cidr) {
+	uint32_t addr;
+	uint8_t prefix;
+
+	if(!parse_cidr(cidr, &addr, &prefix)) {
+		return false;
+	}
+	impl->config.exclude_list->add_subnet(addr, prefix);
+	return true;
+}
+
+void Degreaser::add_exclude(uint32_t addr, uint8_t prefix) {
+	impl->config.exclude_list->add_subnet(ntohl(addr), prefix);
+}
+
+void Degreaser::set_callback(DegreaserResultCallback callback, void* user) {
+	impl->callback = callback;
+	impl->user = user;
+}
+
+/* The same sequence as the degreaser command, minus the command line */
+bool Degreaser::run() {
+	DegreaserConfig& config = impl->config;
+
+	if(impl->ran) {
+		fprintf(stderr, "error: a Degreaser can only be run once\n");
+		return false;
+	}
+	impl->ran = true;
+
+	/* As with the command, a failure here is only a warning */
+	linux_firewall_init(config, impl->handle_signals);
+
+#ifdef HAVE_LIBCPERM
+	if(config.random) {
+		config.subnets = new RandomSubnetList();
+	} else
+#endif /* HAVE_LIBCPERM */
+	{
+		config.subnets = new SubnetList();
+	}
+	for(list<pair<uint32_t, uint8_t> >::iterator iter = impl->targets.begin(); iter != impl->targets.end(); iter++) {
+		config.subnets->add_subnet(iter->first, iter->second);
+	}
+
+	if(impl->callback) {
+		config.outputs.push_back(new OutputCallback(&config, impl->callback, impl->user));
+	}
+
+	scanner_init(&config);
+
+	config.writer = new OutputWriter(&config);
+	config.writer->start();
+	bool ok = scanner_run(&config);
+	config.writer->stop();
+	delete config.writer;
+	config.writer = NULL;
+
+	for(list<Output*>::iterator iter = config.outputs.begin(); iter != config.outputs.end(); iter++) {
+		delete (*iter);
+	}
+	config.outputs.clear();
+
+	linux_firewall_clear(config);
+	return ok;
+}
@@ -0,0 +1,108 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef LIBDEGREASER_H
+#define LIBDEGREASER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "scan_record.h"
+
+/* Embedding API for degreaser. A Degreaser object holds the settings and
+   targets of one scan; run() scans them with the same engine, exclusion
+   handling and classifier as the degreaser command and hands the results
+   to a callback as they are produced:
+
+	void on_results(const ScanRecord* records, size_t count, void* user) { ... }
+
+	Degreaser d;
+	d.set_device("eth0");
+	d.add_target("192.0.2.0/24");
+	d.set_callback(on_results, NULL);
+	d.run();
+
+   Results are delivered in batches from a single output thread, so the
+   callback never runs concurrently with itself. The records are only valid
+   for the duration of the call. Sending raw packets needs CAP_NET_RAW, and
+   the scan installs the same firewall rules the command does. Errors are
+   printed to stderr and reported by run()'s return value; the library never
+   exits the process. */
+
+typedef void (*DegreaserResultCallback)(const ScanRecord* records, size_t count, void* user);
+
+class Degreaser {
+	public:
+		Degreaser();
+		~Degreaser();
+
+		/* Scan settings. The defaults are those of the degreaser command. */
+		void set_device(const std::string& device);
+		void set_port(uint16_t port);
+		void set_window_threshold(uint32_t threshold);
+		void set_timeout(uint16_t seconds);
+		void set_threads(uint16_t threads);
+		void set_event_engine(uint32_t max_inflight);
+		void set_cpus(const std::vector<int>& cpus);
+		void set_source_ports(uint16_t min, uint16_t max);
+		void set_fast_scan(bool fast);
+		void set_single_probe(bool single_probe);
+		void set_random(bool random);
+		void set_dry_run(bool dry_run);
+		void set_exclude_rfc6890(bool exclude);
+
+		/* Report hosts that did not answer too (off by default) */
+		void set_all_results(bool all);
+
+		/* Remove the firewall rules on SIGINT, SIGTERM, SIGHUP, SIGQUIT and
+		   at exit, replacing the process's handlers for those signals while
+		   run() is scanning (off by default). Without it the rules are only
+		   removed when run() returns or the Degreaser is destroyed. Only one
+		   Degreaser at a time can handle signals. */
+		void set_handle_signals(bool handle);
+
+		/* Targets and exclusions, either as "a.b.c.d/len" (or a single
+		   address) or as an address in network byte order and a prefix
+		   length. The string forms return false if they can not be parsed. */
+		bool add_target(const std::string& cidr);
+		void add_target(uint32_t addr, uint8_t prefix);
+		bool add_exclude(const std::string& cidr);
+		void add_exclude(uint32_t addr, uint8_t prefix);
+
+		void set_callback(DegreaserResultCallback callback, void* user);
+
+		/* Scan every target and return once all results have been
+		   delivered. Returns false if the scan could not be started or
+		   failed part way. A Degreaser can only be run once. */
+		bool run();
+
+	private:
+		struct Impl;
+		Impl* impl;
+
+		Degreaser(const Degreaser&);
+		Degreaser& operator=(const Degreaser&);
+};
+
+#endif /* LIBDEGREASER_H */
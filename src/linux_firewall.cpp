@@ -23,16 +23,59 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#ifdef HAVE_LIBNFTABLES
+#include <nftables/libnftables.h>
+#endif
+
+#include <string>
 
 #include "degreaser.h"
+#include "linux_firewall.h"
+
+#define NFT_TABLE_PREFIX	"degreaser_"
+#define MAX_RULES			4
 
 static const char* port_range_file = "/proc/sys/net/ipv4/ip_local_port_range";
-static char iptables_filter[256];
+
+/* What linux_firewall_clear() has to undo for one configuration */
+struct LinuxFirewall {
+	FirewallMode mode;
+	char nft_table[48];
+	char iptables_rules[MAX_RULES][256];
+	int iptables_rule_count;
+	bool nft_owned;
+#ifdef HAVE_LIBNFTABLES
+	struct nft_ctx* nft;
+#endif
+};
+
+/* Rules are removed with this held, so an exit or signal that races with
+   linux_firewall_clear() waits for it rather than leaving rules half
+   removed. signal_firewall is the one set of rules, if any, that the exit
+   and signal handlers clean up. */
+static pthread_mutex_t cleanup_lock = PTHREAD_MUTEX_INITIALIZER;
+static LinuxFirewall* signal_firewall = NULL;
+static uint32_t table_count = 0;
+
+static const int cleanup_signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+#define CLEANUP_SIGNALS	(sizeof(cleanup_signals) / sizeof(cleanup_signals[0]))
+static struct sigaction saved_actions[CLEANUP_SIGNALS];
 
 static bool linux_firewall_get_ephemeral_range(uint16_t* min, uint16_t* max);
-static bool linux_firewall_filter_packets(bool dry_run, uint16_t min, uint16_t max);
+static bool linux_firewall_nft_available(LinuxFirewall* fw);
+static bool linux_firewall_nft_run(LinuxFirewall* fw, const char* cmds, string* output);
+static void linux_firewall_nft_remove_stale(LinuxFirewall* fw);
+static bool linux_firewall_nft_filter(LinuxFirewall* fw, uint16_t min, uint16_t max);
+static bool linux_firewall_iptables_filter(LinuxFirewall* fw, uint16_t min, uint16_t max);
+static void linux_firewall_remove(LinuxFirewall* fw);
+static bool linux_firewall_install_handlers(LinuxFirewall* fw);
+static void linux_firewall_free(LinuxFirewall* fw);
 
-bool linux_firewall_init(DegreaserConfig& config) {
+bool linux_firewall_init(DegreaserConfig& config, bool handle_signals) {
 	uint16_t emph_min, emph_max;
 
 	if(config.dry_run || config.fast_scan) {
@@ -43,38 +86,106 @@ bool linux_firewall_init(DegreaserConfig& config) {
 		return false;
 	}
 
-	config.src_port_max = emph_min - 1;
-	config.src_port_min = config.src_port_max - 1000;
+	if(config.src_port_max == 0) {
+		config.src_port_max = emph_min - 1;
+		config.src_port_min = config.src_port_max - 1000;
+	} else if(config.src_port_min <= emph_max && config.src_port_max >= emph_min) {
+		fprintf(stderr, "warning: Source ports %hu-%hu overlap the ephemeral range %hu-%hu.\n",
+				config.src_port_min, config.src_port_max, emph_min, emph_max);
+	}
+
+	LinuxFirewall* fw = new LinuxFirewall();
+	fw->mode = FIREWALL_NONE;
+	fw->iptables_rule_count = 0;
+	fw->nft_owned = false;
+#ifdef HAVE_LIBNFTABLES
+	fw->nft = NULL;
+#endif
 
-	if(!linux_firewall_filter_packets(config.dry_run, config.src_port_min, config.src_port_max)) {
-		return false;
+	FirewallMode mode = config.firewall;
+	if(mode == FIREWALL_AUTO) {
+		mode = linux_firewall_nft_available(fw) ? FIREWALL_NFTABLES : FIREWALL_IPTABLES;
+	}
+
+	switch(mode) {
+		case FIREWALL_NFTABLES:
+			if(!linux_firewall_nft_filter(fw, config.src_port_min, config.src_port_max)) {
+				fprintf(stderr, "warning: Failed to install nftables rules. The kernel will reset scan connections!\n");
+				linux_firewall_free(fw);
+				return false;
+			}
+			break;
+		case FIREWALL_IPTABLES:
+			if(!linux_firewall_iptables_filter(fw, config.src_port_min, config.src_port_max)) {
+				fprintf(stderr, "warning: Failed to install iptables rules. The kernel will reset scan connections!\n");
+				/* Take back whichever rules did go in */
+				fw->mode = FIREWALL_IPTABLES;
+				linux_firewall_remove(fw);
+				linux_firewall_free(fw);
+				return false;
+			}
+			break;
+		default:
+			linux_firewall_free(fw);
+			return true;
 	}
 
+	fw->mode = mode;
+	config.firewall_state = fw;
+	if(handle_signals) {
+		linux_firewall_install_handlers(fw);
+	}
 	return true;
 }
 
 bool linux_firewall_clear(DegreaserConfig& config) {
+	LinuxFirewall* fw = config.firewall_state;
 
-	if(config.dry_run || config.fast_scan) {
+	if(!fw) {
 		return true;
 	}
 
-	char* ptr = strstr(iptables_filter, "-A");
-	if(!ptr) {
-		LOG_WARNING("Failed to parse iptables filter string. Iptables rules will not be removed!\n");
-		return false;
+	pthread_mutex_lock(&cleanup_lock);
+	linux_firewall_remove(fw);
+	if(signal_firewall == fw) {
+		/* Hand the signals back to whoever had them before */
+		signal_firewall = NULL;
+		for(size_t i = 0; i < CLEANUP_SIGNALS; i++) {
+			sigaction(cleanup_signals[i], &saved_actions[i], NULL);
+		}
 	}
+	pthread_mutex_unlock(&cleanup_lock);
 
-	ptr[1] = 'D';
+	linux_firewall_free(fw);
+	config.firewall_state = NULL;
+	return true;
+}
 
-	LOG_DEBUG("Removing iptables rule: %s\n", iptables_filter);
-	if(0 != system(iptables_filter)) {
-		LOG_WARNING("Removing iptables filter failed!\n");
+bool linux_firewall_parse_mode(const char* name, FirewallMode* mode) {
+	if(0 == strcmp(name, "auto")) {
+		*mode = FIREWALL_AUTO;
+	} else if(0 == strcmp(name, "nftables") || 0 == strcmp(name, "nft")) {
+		*mode = FIREWALL_NFTABLES;
+	} else if(0 == strcmp(name, "iptables")) {
+		*mode = FIREWALL_IPTABLES;
+	} else if(0 == strcmp(name, "none")) {
+		*mode = FIREWALL_NONE;
+	} else {
+		return false;
 	}
-
 	return true;
 }
 
+static void linux_firewall_free(LinuxFirewall* fw) {
+#ifdef HAVE_LIBNFTABLES
+	/* Releases an owner table too, so only after it has been deleted */
+	if(fw->nft) {
+		nft_ctx_free(fw->nft);
+	}
+#endif
+	delete fw;
+}
+
 static bool linux_firewall_get_ephemeral_range(uint16_t* min, uint16_t* max) {
 	FILE* fd = fopen(port_range_file, "r");
 	if(!fd) {
@@ -93,21 +204,288 @@ static bool linux_firewall_get_ephemeral_range(uint16_t* min, uint16_t* max) {
 	return true;
 }
 
-static bool linux_firewall_filter_packets(bool dry_run, uint16_t min, uint16_t max) {
+static bool linux_firewall_nft_available(LinuxFirewall* fw) {
+#ifdef HAVE_LIBNFTABLES
+	if(!fw->nft) {
+		fw->nft = nft_ctx_new(NFT_CTX_DEFAULT);
+	}
+	return fw->nft != NULL;
+#else
+	return 0 == system("nft --version > /dev/null 2>&1");
+#endif
+}
+
+/* Run an nft script, through libnftables if we have it or the nft binary
+   otherwise. If output is given, it receives whatever nft printed. */
+static bool linux_firewall_nft_run(LinuxFirewall* fw, const char* cmds, string* output) {
+#ifdef HAVE_LIBNFTABLES
+	struct nft_ctx* nft = fw->nft;
+	if(!nft && !(nft = fw->nft = nft_ctx_new(NFT_CTX_DEFAULT))) {
+		return false;
+	}
+	if(output) {
+		nft_ctx_buffer_output(nft);
+	}
+	nft_ctx_buffer_error(nft);
+	int rc = nft_run_cmd_from_buffer(nft, cmds);
+	if(output) {
+		*output = nft_ctx_get_output_buffer(nft);
+		nft_ctx_unbuffer_output(nft);
+	}
+	LOG_DEBUG("nft: %s\n", nft_ctx_get_error_buffer(nft));
+	nft_ctx_unbuffer_error(nft);
+	return rc == 0;
+#else
+	char tmpl[] = "/tmp/degreaser-nft.XXXXXX";
+	char buffer[256];
+	string cmd;
+	int fd = -1;
+
+	if(output) {
+		if(-1 == (fd = mkstemp(tmpl))) {
+			return false;
+		}
+		cmd = string("nft -f - > ") + tmpl + " 2> /dev/null";
+	} else {
+		cmd = "nft -f - > /dev/null 2>&1";
+	}
 
-	if(0 > snprintf(iptables_filter , 256, "iptables -A INPUT -p tcp --dport %hu:%hu -j DROP", min, max)) {
-		LOG_WARNING("Failed to build iptables filter string.\n");
+	FILE* p = popen(cmd.c_str(), "w");
+	if(!p) {
+		if(fd != -1) {
+			close(fd);
+			unlink(tmpl);
+		}
 		return false;
 	}
+	fputs(cmds, p);
+	int rc = pclose(p);
 
-	LOG_DEBUG("Adding iptables filter: %s\n", iptables_filter);
+	if(output) {
+		ssize_t n;
+		output->clear();
+		while(0 < (n = read(fd, buffer, sizeof(buffer)))) {
+			output->append(buffer, n);
+		}
+		close(fd);
+		unlink(tmpl);
+	}
+	return rc == 0;
+#endif /* HAVE_LIBNFTABLES */
+}
+
+/* Delete degreaser tables whose owning process no longer exists, e.g. after
+   a crash without owner table support. Tables are named degreaser_<pid> or
+   degreaser_<pid>_<n>. */
+static void linux_firewall_nft_remove_stale(LinuxFirewall* fw) {
+	string tables;
+	size_t pos = 0;
+
+	if(!linux_firewall_nft_run(fw, "list tables ip\n", &tables)) {
+		return;
+	}
+
+	while(string::npos != (pos = tables.find("table ip " NFT_TABLE_PREFIX, pos))) {
+		pos += strlen("table ip ");
+		size_t end = tables.find_first_of(" \t\n{", pos);
+		string name = tables.substr(pos, end == string::npos ? string::npos : end - pos);
+		pid_t pid = strtol(name.c_str() + strlen(NFT_TABLE_PREFIX), NULL, 10);
+		if(pid > 0 && pid != getpid() && -1 == kill(pid, 0) && errno == ESRCH) {
+			string cmd = "delete table ip " + name + "\n";
+			LOG_DEBUG("Removing stale nftables table: %s", cmd.c_str());
+			linux_firewall_nft_run(fw, cmd.c_str(), NULL);
+		}
+	}
+}
+
+/* Replies to the probe port range are dropped at raw priority, before
+   conntrack has looked at them, and the probes themselves are not tracked.
+   Packet sockets see the replies before netfilter, so the scan still does. */
+static bool linux_firewall_nft_filter(LinuxFirewall* fw, uint16_t min, uint16_t max) {
+	char rules[1024];
+	const char* flags[] = { "flags owner;", "" };
+
+	/* Every scan in the process gets its own table */
+	linux_firewall_nft_remove_stale(fw);
+	uint32_t n = __atomic_fetch_add(&table_count, 1, __ATOMIC_RELAXED);
+	if(n == 0) {
+		snprintf(fw->nft_table, sizeof(fw->nft_table), NFT_TABLE_PREFIX "%d", (int)getpid());
+	} else {
+		snprintf(fw->nft_table, sizeof(fw->nft_table), NFT_TABLE_PREFIX "%d_%u", (int)getpid(), n);
+	}
 
-	if(!dry_run) {
-		if(0 != system(iptables_filter)) {
+	/* Owner tables are released by the kernel when our netlink socket goes
+	   away, which only helps if that socket lives as long as we do. */
+#ifdef HAVE_LIBNFTABLES
+	int first = 0;
+#else
+	int first = 1;
+#endif
+	for(int i = first; i < 2; i++) {
+		snprintf(rules, sizeof(rules),
+				"table ip %s {\n"
+				"	%s\n"
+				"	chain prerouting {\n"
+				"		type filter hook prerouting priority -300; policy accept;\n"
+				"		tcp dport %hu-%hu drop\n"
+				"	}\n"
+				"	chain output {\n"
+				"		type filter hook output priority -300; policy accept;\n"
+				"		tcp sport %hu-%hu notrack\n"
+				"	}\n"
+				"}\n",
+				fw->nft_table, flags[i], min, max, min, max);
+
+		LOG_DEBUG("Adding nftables rules:\n%s", rules);
+		if(linux_firewall_nft_run(fw, rules, NULL)) {
+			fw->nft_owned = (i == 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Same rules as nftables, in the iptables raw table */
+static bool linux_firewall_iptables_filter(LinuxFirewall* fw, uint16_t min, uint16_t max) {
+	const char* fmt[] = {
+		"iptables -t raw -I PREROUTING -p tcp --dport %hu:%hu -j DROP",
+		"iptables -t raw -I OUTPUT -p tcp --sport %hu:%hu -j CT --notrack" };
+
+	for(int i = 0; i < 2; i++) {
+		if(0 > snprintf(fw->iptables_rules[i], 256, fmt[i], min, max)) {
+			LOG_WARNING("Failed to build iptables filter string.\n");
+			return false;
+		}
+
+		LOG_DEBUG("Adding iptables filter: %s\n", fw->iptables_rules[i]);
+		if(0 != system(fw->iptables_rules[i])) {
 			LOG_WARNING("Adding iptables filter failed!\n");
 			return false;
 		}
+		fw->iptables_rule_count++;
 	}
 
 	return true;
 }
+
+/* Call with cleanup_lock held. Safe to call more than once. */
+static void linux_firewall_remove(LinuxFirewall* fw) {
+	FirewallMode mode = fw->mode;
+	fw->mode = FIREWALL_NONE;
+
+	if(mode == FIREWALL_NFTABLES) {
+		char cmd[64];
+		snprintf(cmd, sizeof(cmd), "delete table ip %s\n", fw->nft_table);
+		LOG_DEBUG("Removing nftables table: %s", cmd);
+		if(!linux_firewall_nft_run(fw, cmd, NULL) && !fw->nft_owned) {
+			LOG_WARNING("Removing nftables table failed!\n");
+		}
+	} else if(mode == FIREWALL_IPTABLES) {
+		while(fw->iptables_rule_count > 0) {
+			char* rule = fw->iptables_rules[--fw->iptables_rule_count];
+			char* ptr = strstr(rule, "-I");
+			if(!ptr) {
+				continue;
+			}
+			ptr[1] = 'D';
+			LOG_DEBUG("Removing iptables rule: %s\n", rule);
+			if(0 != system(rule)) {
+				LOG_WARNING("Removing iptables filter failed!\n");
+			}
+		}
+	}
+}
+
+static void linux_firewall_atexit() {
+	pthread_mutex_lock(&cleanup_lock);
+	if(signal_firewall) {
+		linux_firewall_remove(signal_firewall);
+	}
+	pthread_mutex_unlock(&cleanup_lock);
+}
+
+/* Removing rules runs nft, iptables or libnftables, none of which are safe
+   in a signal handler while other threads may hold the malloc or stdio
+   locks. The handler only passes the signal number down a pipe; this
+   thread does the cleanup and then lets the signal take its default
+   action, which the handler's SA_RESETHAND has restored. */
+static int signal_pipe[2];
+
+static void linux_firewall_signal(int sig) {
+	int saved_errno = errno;
+	if(write(signal_pipe[1], &sig, sizeof(sig)) < 0) {
+		/* Nothing safe to do about it here */
+	}
+	errno = saved_errno;
+}
+
+static void* linux_firewall_signal_thread(void* arg) {
+	int sig;
+
+	for(;;) {
+		if(sizeof(sig) != read(signal_pipe[0], &sig, sizeof(sig))) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return NULL;
+		}
+
+		pthread_mutex_lock(&cleanup_lock);
+		if(signal_firewall) {
+			linux_firewall_remove(signal_firewall);
+		}
+		pthread_mutex_unlock(&cleanup_lock);
+
+		/* Always raised again: if the rules were cleared in the meantime,
+		   the handlers that were there before are back and get it instead */
+		kill(getpid(), sig);
+	}
+}
+
+/* Clean fw up at exit and on SIGINT, SIGTERM, SIGHUP and SIGQUIT. Only one
+   set of rules in the process can be looked after this way. */
+static bool linux_firewall_install_handlers(LinuxFirewall* fw) {
+	static bool started = false;
+
+	pthread_mutex_lock(&cleanup_lock);
+	if(signal_firewall) {
+		pthread_mutex_unlock(&cleanup_lock);
+		fprintf(stderr, "warning: Firewall rules of another scan already handle signals.\n");
+		return false;
+	}
+
+	if(!started) {
+		pthread_t tid;
+		pthread_attr_t attr;
+
+		if(0 != pipe(signal_pipe)) {
+			pthread_mutex_unlock(&cleanup_lock);
+			fprintf(stderr, "warning: Failed to create the firewall cleanup pipe. Reason: %s\n", strerror(errno));
+			return false;
+		}
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if(0 != pthread_create(&tid, &attr, linux_firewall_signal_thread, NULL)) {
+			pthread_attr_destroy(&attr);
+			close(signal_pipe[0]);
+			close(signal_pipe[1]);
+			pthread_mutex_unlock(&cleanup_lock);
+			fprintf(stderr, "warning: Failed to start the firewall cleanup thread. Rules are only removed on a normal exit.\n");
+			return false;
+		}
+		pthread_attr_destroy(&attr);
+		atexit(linux_firewall_atexit);
+		started = true;
+	}
+
+	signal_firewall = fw;
+	for(size_t i = 0; i < CLEANUP_SIGNALS; i++) {
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = linux_firewall_signal;
+		sa.sa_flags = SA_RESETHAND;
+		sigaction(cleanup_signals[i], &sa, &saved_actions[i]);
+	}
+	pthread_mutex_unlock(&cleanup_lock);
+	return true;
+}
@@ -24,7 +24,25 @@
 
 #include "degreaser.h"
 
-bool linux_firewall_init(DegreaserConfig& config);
+/* Keeps the kernel from answering or tracking scanner traffic. Replies to
+   the source port range are dropped before connection tracking sees them,
+   and outgoing probes are marked untracked. With nftables the rules live in
+   a table named after the process, which the kernel removes by itself when
+   libnftables supports owner tables, even after a crash. Otherwise the rules
+   are removed at exit or on SIGINT, SIGTERM, SIGHUP or SIGQUIT, but a crash
+   or SIGKILL leaves them behind. Tables left by dead processes are cleaned
+   up on the next start; iptables rules have to be removed by hand.
+
+   The state of the installed rules lives in config.firewall_state, so
+   several configurations in one process each get their own table. The exit
+   and signal cleanup is only set up if handle_signals is given, which takes
+   over the process's handlers for those signals until the rules are cleared;
+   only one configuration at a time can have it. */
+
+bool linux_firewall_init(DegreaserConfig& config, bool handle_signals);
 bool linux_firewall_clear(DegreaserConfig& config);
 
+/* Parses auto, nftables, iptables or none */
+bool linux_firewall_parse_mode(const char* name, FirewallMode* mode);
+
 #endif /* LINUX_FIREWALL_H */
@@ -0,0 +1,335 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <string>
+
+#include "degreaser.h"
+#include "metrics.h"
+
+MetricsExporter::MetricsExporter(const DegreaserConfig* c) : config(c) {
+	listen_fd = -1;
+	running = false;
+	textfile_failed = false;
+	last_sent = last_recv = 0;
+	pps_sent = pps_recv = 0;
+	gettimeofday(&start_time, NULL);
+	last_sample = start_time;
+}
+
+MetricsExporter::~MetricsExporter() {
+	stop();
+	if(listen_fd >= 0) {
+		close(listen_fd);
+	}
+}
+
+bool MetricsExporter::set_textfile(string filename) {
+	textfile = filename;
+	return true;
+}
+
+/* spec is either "unix:<path>", "<port>" or "<address>:<port>". A bare port
+   listens on 127.0.0.1 only. */
+bool MetricsExporter::set_listen(string spec) {
+	int fd;
+
+	if(spec.compare(0, 5, "unix:") == 0) {
+		struct sockaddr_un sun;
+		string path = spec.substr(5);
+
+		if(path.size() >= sizeof(sun.sun_path)) {
+			fprintf(stderr, "error: metrics socket path is too long: %s\n", path.c_str());
+			return false;
+		}
+
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, path.c_str());
+		unlink(path.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0 || 0 != bind(fd, (struct sockaddr*)&sun, sizeof(sun))) {
+			fprintf(stderr, "error: failed to bind metrics socket '%s'. Reason: %s\n", path.c_str(), strerror(errno));
+			if(fd >= 0) close(fd);
+			return false;
+		}
+	} else {
+		struct sockaddr_in sin;
+		string host = "127.0.0.1";
+		string port = spec;
+		size_t colon = spec.rfind(':');
+		char* endptr;
+		int on = 1;
+
+		if(colon != string::npos) {
+			host = spec.substr(0, colon);
+			port = spec.substr(colon + 1);
+		}
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(strtol(port.c_str(), &endptr, 10));
+		if(*endptr != '\0' || port.empty() || 1 != inet_pton(AF_INET, host.c_str(), &sin.sin_addr)) {
+			fprintf(stderr, "error: invalid metrics listen address: %s\n", spec.c_str());
+			return false;
+		}
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd >= 0) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		}
+		if(fd < 0 || 0 != bind(fd, (struct sockaddr*)&sin, sizeof(sin))) {
+			fprintf(stderr, "error: failed to bind metrics socket '%s'. Reason: %s\n", spec.c_str(), strerror(errno));
+			if(fd >= 0) close(fd);
+			return false;
+		}
+	}
+
+	if(0 != listen(fd, 8)) {
+		fprintf(stderr, "error: failed to listen on metrics socket. Reason: %s\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	listen_fd = fd;
+	return true;
+}
+
+void MetricsExporter::start() {
+	if(running || (listen_fd < 0 && textfile == "")) {
+		return;
+	}
+	running = true;
+	pthread_create(&tid, NULL, metrics_thread, this);
+}
+
+void MetricsExporter::stop() {
+	if(!running) {
+		return;
+	}
+	__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+	pthread_join(tid, NULL);
+
+	/* Leave the final totals behind for the textfile collector */
+	sample();
+	if(textfile != "") {
+		write_textfile();
+	}
+}
+
+void* MetricsExporter::metrics_thread(void* arg) {
+	MetricsExporter* m = (MetricsExporter*)arg;
+	struct timeval now;
+	time_t last_write = 0;
+
+	while(__atomic_load_n(&m->running, __ATOMIC_ACQUIRE)) {
+		if(m->listen_fd >= 0) {
+			struct pollfd pfd;
+			pfd.fd = m->listen_fd;
+			pfd.events = POLLIN;
+			if(1 == poll(&pfd, 1, SAMPLE_INTERVAL_MS)) {
+				int client = accept(m->listen_fd, NULL, NULL);
+				if(client >= 0) {
+					m->serve_client(client);
+					close(client);
+				}
+			}
+		} else {
+			usleep(SAMPLE_INTERVAL_MS * 1000);
+		}
+
+		gettimeofday(&now, NULL);
+		if((now.tv_sec - m->last_sample.tv_sec) * 1000 + (now.tv_usec - m->last_sample.tv_usec) / 1000 >= (long)SAMPLE_INTERVAL_MS) {
+			m->sample();
+		}
+
+		if(m->textfile != "" && now.tv_sec - last_write >= TEXTFILE_INTERVAL_S) {
+			m->write_textfile();
+			last_write = now.tv_sec;
+		}
+	}
+
+	return NULL;
+}
+
+/* Update the packet rates from the change since the last sample */
+void MetricsExporter::sample() {
+	struct timeval now;
+	Stats st;
+
+	config->stats.aggregate(&st);
+	gettimeofday(&now, NULL);
+
+	double elapsed = (now.tv_sec - last_sample.tv_sec) + (now.tv_usec - last_sample.tv_usec) / 1000000.0;
+	if(elapsed > 0) {
+		pps_sent = (st.packets_sent - last_sent) / elapsed;
+		pps_recv = (st.packets_recv - last_recv) / elapsed;
+	}
+
+	last_sample = now;
+	last_sent = st.packets_sent;
+	last_recv = st.packets_recv;
+}
+
+static void metric(string& out, const char* name, const char* type, const char* help, double value) {
+	char buf[256];
+
+	snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+	out += buf;
+}
+
+static void metric_result(string& out, const char* result, uint64_t value) {
+	char buf[128];
+
+	snprintf(buf, sizeof(buf), "degreaser_results_total{result=\"%s\"} %" PRIu64 "\n", result, value);
+	out += buf;
+}
+
+string MetricsExporter::render() {
+	string out;
+	Stats st;
+
+	config->stats.aggregate(&st);
+	uint64_t attempted = st.scans + st.excluded;
+
+	metric(out, "degreaser_start_time_seconds", "gauge", "Time the scan was started.", start_time.tv_sec);
+	metric(out, "degreaser_packets_sent_total", "counter", "Packets sent.", st.packets_sent);
+	metric(out, "degreaser_send_errors_total", "counter", "Probes the kernel refused to send.", st.send_errors);
+	metric(out, "degreaser_packets_received_total", "counter", "Replies received.", st.packets_recv);
+	metric(out, "degreaser_packets_sent_per_second", "gauge", "Packets sent per second over the last sample interval.", pps_sent);
+	metric(out, "degreaser_packets_received_per_second", "gauge", "Replies received per second over the last sample interval.", pps_recv);
+	metric(out, "degreaser_probes_in_flight", "gauge", "Hosts currently being scanned.", st.in_flight);
+	metric(out, "degreaser_targets", "gauge", "Total number of target addresses.", config->subnets->count());
+	metric(out, "degreaser_targets_done", "gauge", "Target addresses taken from the target list so far.", config->subnets->offset());
+	metric(out, "degreaser_scans_total", "counter", "Hosts scanned.", st.scans);
+	metric(out, "degreaser_excluded_total", "counter", "Target addresses skipped by the exclude list.", st.excluded);
+	metric(out, "degreaser_exclusion_hit_ratio", "gauge", "Fraction of target addresses matched by the exclude list.",
+			attempted ? st.excluded / (double)attempted : 0);
+	metric(out, "degreaser_skipped_total", "counter", "Target addresses not probed because their /24 is a known tarpit range.", st.skipped);
+	metric(out, "degreaser_unchanged_total", "counter", "Target addresses not probed because the result store has a recent result.", st.unchanged);
+	metric(out, "degreaser_unreachable_skipped_total", "counter", "Target addresses not probed because routers reported their /24 unreachable.", st.dark_skipped);
+	metric(out, "degreaser_retried_total", "counter", "Probes re-sent to non-responders by the retry passes.", st.retried);
+	metric(out, "degreaser_receive_dropped_total", "counter", "Replies dropped by the event engine's receive sockets before they were read.", st.recv_dropped);
+
+	out += "# HELP degreaser_results_total Hosts by scan result.\n# TYPE degreaser_results_total counter\n";
+	metric_result(out, "no_response", st.scans - st.hits);
+	metric_result(out, "real_host", st.real);
+	metric_result(out, "reject", st.rejecting);
+	metric_result(out, "unreachable", st.unreachable);
+	metric_result(out, "zero_window", st.zero_win);
+	metric_result(out, "tarpit", st.tarpits);
+	metric_result(out, "labrea", st.labrea);
+	metric_result(out, "iptables", st.iptables);
+	metric_result(out, "delude", st.delude);
+	metric_result(out, "error", st.errors);
+
+	LatencyStats* latency = new LatencyStats();
+	config->stats.aggregate_latency(latency);
+
+	const static double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	out += "# HELP degreaser_response_time_microseconds SYN/ACK response time by scan result.\n"
+			"# TYPE degreaser_response_time_microseconds summary\n";
+	for(int i = 0; i < LATENCY_CLASSES; i++) {
+		Histogram& h = latency->response_time[i];
+		const char* name = LatencyStats::class_name(i);
+		char buf[160];
+
+		for(uint32_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+			snprintf(buf, sizeof(buf), "degreaser_response_time_microseconds{result=\"%s\",quantile=\"%g\"} %u\n",
+					name, quantiles[q], h.percentile(quantiles[q]));
+			out += buf;
+		}
+		snprintf(buf, sizeof(buf), "degreaser_response_time_microseconds_count{result=\"%s\"} %" PRIu64 "\n",
+				name, h.count());
+		out += buf;
+	}
+	delete latency;
+
+	return out;
+}
+
+/* Write to a temporary file and rename it so the collector never sees a
+   partial file */
+void MetricsExporter::write_textfile() {
+	string tmp = textfile + ".tmp";
+	string body = render();
+
+	FILE* fd = fopen(tmp.c_str(), "w");
+	if(!fd) {
+		textfile_error("open", tmp);
+		return;
+	}
+	bool ok = body.size() == fwrite(body.data(), 1, body.size(), fd);
+	if(0 != fclose(fd) || !ok) {
+		textfile_error("write", tmp);
+		return;
+	}
+
+	if(0 != rename(tmp.c_str(), textfile.c_str())) {
+		textfile_error("rename", tmp);
+		return;
+	}
+	textfile_failed = false;
+}
+
+/* Warn about the first failure only, the file is rewritten every few seconds */
+void MetricsExporter::textfile_error(const char* what, const string& filename) {
+	if(!textfile_failed) {
+		fprintf(stderr, "warning: failed to %s metrics file '%s'. Reason: %s\n", what, filename.c_str(), strerror(errno));
+		textfile_failed = true;
+	}
+}
+
+/* Answers any request with the metrics page. Clients get a short timeout
+   so a stuck scraper can't stall the exporter. */
+void MetricsExporter::serve_client(int fd) {
+	struct timeval tv = { 1, 0 };
+	char request[1024];
+	char header[128];
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if(recv(fd, request, sizeof(request), 0) < 0) {
+		return;
+	}
+
+	string body = render();
+	int len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n\r\n", body.size());
+
+	if(len > 0 && send(fd, header, len, MSG_NOSIGNAL) == len) {
+		send(fd, body.data(), body.size(), MSG_NOSIGNAL);
+	}
+}
@@ -0,0 +1,73 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <string>
+
+#include "degreaser.h"
+
+/* Exports live scan metrics in the Prometheus text format. Metrics can be
+   written periodically to a file (for node_exporter's textfile collector)
+   and/or served over HTTP on a loopback TCP port or a Unix socket. All of
+   the work happens on a background thread that reads the sharded stats. */
+class MetricsExporter {
+	public:
+		MetricsExporter(const DegreaserConfig* c);
+		~MetricsExporter();
+
+		bool set_textfile(string filename);
+		bool set_listen(string spec);
+
+		void start();
+		void stop();
+
+	private:
+		const DegreaserConfig* config;
+		string textfile;
+		bool textfile_failed;		/* Last write failed and was reported */
+		int listen_fd;
+		pthread_t tid;
+		bool running;
+
+		struct timeval start_time;
+		struct timeval last_sample;
+		uint64_t last_sent;
+		uint64_t last_recv;
+		double pps_sent;
+		double pps_recv;
+
+		static void* metrics_thread(void* arg);
+		void sample();
+		string render();
+		void write_textfile();
+		void textfile_error(const char* what, const string& filename);
+		void serve_client(int fd);
+
+		const static uint32_t SAMPLE_INTERVAL_MS = 1000;
+		const static uint32_t TEXTFILE_INTERVAL_S = 10;
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,119 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stdint.h>
+
+/* Bounded lock-free multi-producer, single-consumer queue. Each cell carries
+   a sequence number that tells producers and the consumer whether the cell
+   is free or holds data for the current lap around the ring, so the only
+   contended operation is the CAS on head between producers.
+
+   T must be cheap to copy. The capacity is rounded up to a power of two. */
+template<class T>
+class MPSCQueue {
+	public:
+		MPSCQueue(uint32_t size) {
+			capacity = 1;
+			while(capacity < size) {
+				capacity <<= 1;
+			}
+			mask = capacity - 1;
+			cells = new Cell[capacity];
+			for(uint64_t i = 0; i < capacity; i++) {
+				cells[i].seq = i;
+			}
+			head = tail = 0;
+		}
+
+		~MPSCQueue() {
+			delete[] cells;
+		}
+
+		/* Returns false if the queue is full. Safe to call from any thread. */
+		bool try_push(const T& v) {
+			uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+			Cell* c;
+
+			for(;;) {
+				c = &cells[pos & mask];
+				uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+				int64_t diff = (int64_t)seq - (int64_t)pos;
+				if(diff == 0) {
+					if(__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						break;
+					}
+				} else if(diff < 0) {
+					return false;
+				} else {
+					pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+				}
+			}
+
+			c->data = v;
+			__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		/* Returns false if the queue is empty. Only one thread may pop. */
+		bool try_pop(T* v) {
+			Cell* c = &cells[tail & mask];
+			uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+
+			if((int64_t)seq - (int64_t)(tail + 1) < 0) {
+				return false;
+			}
+
+			*v = c->data;
+			__atomic_store_n(&c->seq, tail + capacity, __ATOMIC_RELEASE);
+			__atomic_store_n(&tail, tail + 1, __ATOMIC_RELAXED);
+			return true;
+		}
+
+		/* Approximate number of queued items */
+		uint64_t size() const {
+			return __atomic_load_n(&head, __ATOMIC_RELAXED) - __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		}
+
+	private:
+		struct Cell {
+			uint64_t seq;
+			T data;
+		};
+
+		Cell* cells;
+		uint64_t capacity;
+		uint64_t mask;
+
+		/* Keep the producer and consumer indices on separate cache lines */
+		char pad0[64];
+		uint64_t head;
+		char pad1[64 - sizeof(uint64_t)];
+		uint64_t tail;
+		char pad2[64 - sizeof(uint64_t)];
+
+		MPSCQueue(const MPSCQueue&);
+		MPSCQueue& operator=(const MPSCQueue&);
+};
+
+#endif /* MPSC_QUEUE_H */
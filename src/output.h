@@ -23,16 +23,21 @@
 #define OUTPUT_H
 
 #include "degreaser.h"
-#include "scan.h"
+#include "scan_record.h"
 
 class Output {
 	public:
-		Output(const DegreaserConfig* c) : config(c) { };
+		Output(const DegreaserConfig* c) : config(c), failed(false) { };
 		virtual ~Output() { };
-		virtual void output_scan(Scan*) = 0;
+		virtual void output_scan(const ScanRecord& r) = 0;
 		virtual void output_message(const char* f, ...) = 0;
+		virtual void output_flush() { };
+
+		/* True once a write has failed; nothing more is written after that */
+		bool output_failed() const { return failed; };
 	protected:
 		const DegreaserConfig* config;
+		bool failed;
 };
 
 #endif /* OUTPUT_H */
@@ -0,0 +1,67 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <stdint.h>
+
+#include "../scan_record.h"
+
+/* Layout of a binary results file:
+
+	BinaryFileHeader
+	ScanRecord[record_count]		written in blocks of records_per_block
+	BinaryIndexEntry[index_count]	one entry per block
+
+   The header is rewritten when the file is closed. If the writer did not
+   exit cleanly, index_offset is zero and readers should treat everything
+   after the header as records, up to the last complete record. */
+
+#define BINARY_FORMAT_MAGIC			"DGRSCAN"
+#define BINARY_FORMAT_VERSION		2
+#define BINARY_FORMAT_BYTE_ORDER	0x01020304
+
+/* Version 1 records are the first 24 bytes of a ScanRecord, up to ttl */
+#define BINARY_FORMAT_V1_RECORD_SIZE	24
+
+struct BinaryFileHeader {
+	char magic[8];
+	uint32_t byte_order;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t records_per_block;
+	uint16_t port;
+	uint16_t reserved0;
+	uint64_t start_time;
+	uint64_t record_count;
+	uint64_t index_offset;
+	uint64_t index_count;
+	uint8_t reserved[16];
+};
+
+struct BinaryIndexEntry {
+	uint64_t offset;			/* File offset of the first record in the block */
+	uint32_t count;				/* Number of records in the block */
+	uint32_t first_timestamp;	/* Timestamp of the first record in the block */
+};
+
+#endif /* BINARY_FORMAT_H */
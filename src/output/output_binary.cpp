@@ -0,0 +1,124 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+
+#include "output_binary.h"
+#include "../scan_record.h"
+
+OutputBinary::OutputBinary(const DegreaserConfig* c, string fn) : Output(c), filename(fn) {
+	fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "error: failed to open output file '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	block = new ScanRecord[RECORDS_PER_BLOCK];
+	block_count = 0;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BINARY_FORMAT_MAGIC, sizeof(BINARY_FORMAT_MAGIC));
+	header.byte_order = BINARY_FORMAT_BYTE_ORDER;
+	header.version = BINARY_FORMAT_VERSION;
+	header.record_size = sizeof(ScanRecord);
+	header.records_per_block = RECORDS_PER_BLOCK;
+	header.port = config->port;
+	header.start_time = time(NULL);
+
+	/* The header is written now so a partially written file can still be read,
+	   and rewritten with the final counts and index location on close. */
+	offset = 0;
+	write_all(&header, sizeof(header));
+}
+
+OutputBinary::~OutputBinary() {
+	write_block();
+
+	header.index_offset = offset;
+	header.index_count = index.size();
+	if(!index.empty()) {
+		write_all(&index[0], index.size() * sizeof(BinaryIndexEntry));
+	}
+
+	if(!failed && (ssize_t)sizeof(header) != pwrite(fd, &header, sizeof(header), 0)) {
+		fprintf(stderr, "warning: failed to finalize binary output file '%s'\n", filename.c_str());
+	}
+
+	close(fd);
+	delete[] block;
+}
+
+void OutputBinary::output_scan(const ScanRecord& r) {
+	if(failed) {
+		return;
+	}
+	block[block_count++] = r;
+	if(block_count == RECORDS_PER_BLOCK) {
+		write_block();
+	}
+}
+
+void OutputBinary::output_message(const char* f, ...) {
+	// Messages don't get written to output file.
+}
+
+void OutputBinary::write_block() {
+	BinaryIndexEntry entry;
+
+	if(block_count == 0) {
+		return;
+	}
+
+	entry.offset = offset;
+	entry.count = block_count;
+	entry.first_timestamp = block[0].timestamp;
+	index.push_back(entry);
+
+	write_all(block, block_count * sizeof(ScanRecord));
+	header.record_count += block_count;
+	block_count = 0;
+}
+
+void OutputBinary::write_all(const void* buf, size_t len) {
+	const char* ptr = (const char*)buf;
+
+	while(len > 0 && !failed) {
+		ssize_t n = write(fd, ptr, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "error: failed to write to '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+			failed = true;
+			return;
+		}
+		ptr += n;
+		len -= n;
+		offset += n;
+	}
+}
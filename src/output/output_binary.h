@@ -0,0 +1,53 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef OUTPUT_BINARY_H
+#define OUTPUT_BINARY_H
+
+#include <string>
+#include <vector>
+
+#include "../output.h"
+#include "binary_format.h"
+
+class OutputBinary : public Output {
+	public:
+		OutputBinary(const DegreaserConfig*, string);
+		~OutputBinary();
+
+		void output_scan(const ScanRecord& r);
+		void output_message(const char* f, ...);
+	private:
+		int fd;
+		string filename;
+		BinaryFileHeader header;
+		ScanRecord* block;
+		uint32_t block_count;
+		uint64_t offset;
+		vector<BinaryIndexEntry> index;
+
+		void write_block();
+		void write_all(const void* buf, size_t len);
+
+		const static uint32_t RECORDS_PER_BLOCK = 8192;
+};
+
+#endif /* OUTPUT_BINARY_H */
@@ -0,0 +1,48 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include "output_callback.h"
+#include "../scan_record.h"
+
+OutputCallback::OutputCallback(const DegreaserConfig* c, DegreaserResultCallback cb, void* u) : Output(c), callback(cb), user(u) { }
+
+OutputCallback::~OutputCallback() {
+	output_flush();
+}
+
+void OutputCallback::output_scan(const ScanRecord& r) {
+	if(!config->all_scans && r.result == NO_RESPONSE) {
+		return;
+	}
+	batch.push_back(r);
+}
+
+void OutputCallback::output_message(const char* f, ...) {
+	// Progress messages are only for the console.
+}
+
+void OutputCallback::output_flush() {
+	if(!batch.empty()) {
+		callback(&batch[0], batch.size(), user);
+		batch.clear();
+	}
+}
@@ -1,12 +1,10 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string>
-#include <crafter.h>
+#include <arpa/inet.h>
 
 #include "output_console.h"
-#include "../scan.h"
-
-using namespace Crafter;
+#include "../scan_record.h"
 
 OutputConsole::OutputConsole(const DegreaserConfig* c) : Output(c) {
 }
@@ -14,24 +12,31 @@ OutputConsole::OutputConsole(const DegreaserConfig* c) : Output(c) {
 OutputConsole::~OutputConsole() {
 }
 
-void OutputConsole::output_scan(Scan* s) {
+void OutputConsole::output_scan(const ScanRecord& r) {
 	char tcp_data[128];
+	char addr[INET_ADDRSTRLEN];
+	char flags[5];
+	char opts[5];
 
-	if(!config->all_scans && s->get_result() == NO_RESPONSE) {
+	if(!config->all_scans && r.result == NO_RESPONSE) {
 		return;
 	}
 
-	if(s->get_result() > NO_RESPONSE) {
+	if(r.result > NO_RESPONSE) {
 		snprintf(tcp_data, 128, "RespTime=%-7u  WinSize=%-7u  TCPFlags=%-7s  TCPOptions=%s",
-				s->response_time,
-				s->window_size,
-				s->flags_to_string(),
-				s->options_to_string());
+				r.response_time,
+				r.window_size,
+				scan_flags_to_string(r.flags, flags),
+				scan_options_to_string(r.options, opts));
 	} else {
 		tcp_data[0] = '\0';
 	}
 
-	fprintf(stdout, "Host %-15s : %s %s\n", s->addr.c_str(), s->result_to_string(), tcp_data);
+	inet_ntop(AF_INET, &r.addr, addr, sizeof(addr));
+	fprintf(stdout, "Host %-15s : %s %s\n", addr, scan_result_to_string(r.result), tcp_data);
+}
+
+void OutputConsole::output_flush() {
 	fflush(stdout);
 }
 
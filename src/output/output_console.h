@@ -32,8 +32,9 @@ class OutputConsole: public Output {
 		OutputConsole(const DegreaserConfig*);
 		~OutputConsole();
 
-		void output_scan(Scan*);
+		void output_scan(const ScanRecord& r);
 		void output_message(const char* f, ...);
+		void output_flush();
 	private:
 		pthread_mutex_t lock;
 };
@@ -20,13 +20,12 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
-#include <crafter.h>
+#include <arpa/inet.h>
 
 #include "output_csv.h"
-#include "../scan.h"
-
-using namespace Crafter;
+#include "../scan_record.h"
 
 OutputCSV::OutputCSV(const DegreaserConfig* c, string filename) : Output(c) {
 	out = fopen(filename.c_str(), "w");
@@ -41,15 +40,22 @@ OutputCSV::~OutputCSV() {
 	fclose(out);
 }
 
-void OutputCSV::output_scan(Scan* s) {
+void OutputCSV::output_scan(const ScanRecord& r) {
+	char addr[INET_ADDRSTRLEN];
+	char flags[5];
+	char opts[5];
 
+	inet_ntop(AF_INET, &r.addr, addr, sizeof(addr));
 	fprintf(out, "%s,%s,%u,%u,%s,%s\n",
-			s->addr.c_str(),
-			s->result_to_string(),
-			s->response_time,
-			s->window_size,
-			s->flags_to_string(),
-			s->options_to_string());
+			addr,
+			scan_result_to_string(r.result),
+			r.response_time,
+			r.window_size,
+			scan_flags_to_string(r.flags, flags),
+			scan_options_to_string(r.options, opts));
+}
+
+void OutputCSV::output_flush() {
 	fflush(out);
 }
 
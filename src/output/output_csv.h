@@ -31,8 +31,9 @@ class OutputCSV : public Output {
 		OutputCSV(const DegreaserConfig*, string);
 		~OutputCSV();
 
-		void output_scan(Scan*);
+		void output_scan(const ScanRecord& r);
 		void output_message(const char* f, ...);
+		void output_flush();
 	private:
 		FILE* out;
 };
@@ -21,54 +21,94 @@
 
 #ifdef HAVE_CURSES
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 #include <string>
-#include <crafter.h>
 #include <ncurses.h>
 
 #include "output_curses.h"
-#include "../scan.h"
-
-using namespace Crafter;
+#include "../scan_record.h"
 
 OutputCurses::OutputCurses(const DegreaserConfig* c) : Output(c) {
-	pthread_mutex_init(&console_lock, NULL);
+	pthread_mutex_init(&ring_lock, NULL);
+	history_count = 0;
+	message[0] = '\0';
+
+	gettimeofday(&last_frame, NULL);
+	last_sent = last_recv = 0;
+	last_scans = 0;
+	pps_sent = pps_recv = scan_rate = 0;
+
 	initscr();
 	start_color();
 	init_pair(1, COLOR_RED, COLOR_BLACK);
 	init_pair(2, COLOR_GREEN, COLOR_BLACK);
 	init_pair(3, COLOR_YELLOW, COLOR_BLACK);
-//	output_scan(NULL);
+
+	running = true;
+	pthread_create(&render_tid, NULL, render_thread, this);
 }
 
 OutputCurses::~OutputCurses() {
+	__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+	pthread_join(render_tid, NULL);
+
+	/* Draw one last frame so the final totals are on screen */
+	render();
+
 	printw("\n\nScan Complete. Press any key to exit.");
 	refresh();
 	getch();
 	endwin();
 	printf("\n");
-	pthread_mutex_destroy(&console_lock);
+	pthread_mutex_destroy(&ring_lock);
 }
 
-void OutputCurses::output_scan(Scan* s) {
-	const static int header_size = 5;
-	int num_rows, num_cols;
-	int row, col;
+void OutputCurses::output_scan(const ScanRecord& r) {
+	pthread_mutex_lock(&ring_lock);
+	history[history_count % HISTORY_SIZE] = r;
+	history_count++;
+	pthread_mutex_unlock(&ring_lock);
+}
+
+void* OutputCurses::render_thread(void* arg) {
+	OutputCurses* o = (OutputCurses*)arg;
 
-	pthread_mutex_lock(&console_lock);
+	while(__atomic_load_n(&o->running, __ATOMIC_ACQUIRE)) {
+		o->render();
+		usleep(FRAME_INTERVAL_US);
+	}
+
+	return NULL;
+}
+
+void OutputCurses::render() {
+	const static int header_size = 6;
+	struct timeval now;
+	Stats st;
+	int num_rows, num_cols;
+	char eta_str[32];
 
 	getmaxyx(stdscr, num_rows, num_cols);
-	getyx(stdscr, row, col);
 
 	uint32_t total_count = config->subnets->count();
 	uint32_t current_count = config->subnets->offset();
-	uint32_t percent = (total_count == 0? 0 : current_count * 100 / total_count);
-	uint8_t width = num_cols - 10;
+	uint32_t percent = (total_count == 0? 0 : (uint64_t)current_count * 100 / total_count);
+	int width = num_cols - 10;
+	if(width < 1) {
+		width = 1;
+	}
 	char* bar_str = (char*)alloca(width+1);
 
 	for(int i = 0; i < width; i++) {
-		if(i < (percent * width / 100)) {
+		if(i < (int)(percent * width / 100)) {
 			bar_str[i] = '=';
-		} else if(i == (percent * width / 100)) {
+		} else if(i == (int)(percent * width / 100)) {
 			bar_str[i] = '>';
 		} else {
 			bar_str[i] = ' ';
@@ -76,50 +116,93 @@ void OutputCurses::output_scan(Scan* s) {
 	}
 	bar_str[width] = '\0';
 
-	if(scan_history.size() > num_rows - header_size - 4) {
-		scan_history.pop_front();
+	/* Update the rates, smoothing them over roughly a second of frames */
+	config->stats.aggregate(&st);
+	uint64_t sent = st.packets_sent;
+	uint64_t recv = st.packets_recv;
+	uint64_t scans = st.scans;
+	gettimeofday(&now, NULL);
+	double elapsed = (now.tv_sec - last_frame.tv_sec) + (now.tv_usec - last_frame.tv_usec) / 1000000.0;
+	if(elapsed > 0) {
+		pps_sent = 0.8 * pps_sent + 0.2 * ((sent - last_sent) / elapsed);
+		pps_recv = 0.8 * pps_recv + 0.2 * ((recv - last_recv) / elapsed);
+		scan_rate = 0.8 * scan_rate + 0.2 * ((scans - last_scans) / elapsed);
+	}
+	last_frame = now;
+	last_sent = sent;
+	last_recv = recv;
+	last_scans = scans;
+
+	if(scan_rate >= 1 && total_count > current_count) {
+		uint32_t eta = (total_count - current_count) / scan_rate;
+		snprintf(eta_str, sizeof(eta_str), "%u:%02u:%02u", eta / 3600, (eta / 60) % 60, eta % 60);
+	} else {
+		snprintf(eta_str, sizeof(eta_str), "--:--:--");
 	}
-	scan_history.push_back(*s);
-
 
 	move(0, 0);
-	printw("IP: %10u/%-10u Scanned IPs: %-10u       Excluded IPs: %-10u   ",
-			config->subnets->offset(), config->subnets->count(),
-			config->total_scans, config->total_excluded);
+	printw("IP: %10u/%-10u Scanned IPs: %-10" PRIu64 "       Excluded IPs: %-10" PRIu64 "   ",
+			current_count, total_count,
+			st.scans, st.excluded);
 	move(1, 0);
-	printw("Real Hosts: %-10u    Rejecting Hosts: %-10u   Errors: %-10u",
-			config->total_real, config->total_rejecting, config->total_errors);
+	printw("Real Hosts: %-10" PRIu64 "    Rejecting Hosts: %-10" PRIu64 "   Errors: %-10" PRIu64,
+			st.real, st.rejecting, st.errors);
 	move(2, 0);
-	printw("Tarpits: %-10u       LaBrea: %-10u            iptables(tarpit): %-10u",
-			config->total_tarpits, config->total_labrea, config->total_iptables);
+	printw("Tarpits: %-10" PRIu64 "       LaBrea: %-10" PRIu64 "            iptables(tarpit): %-10" PRIu64,
+			st.tarpits, st.labrea, st.iptables);
 	move(3, 0);
-	printw("         %-10s               %-10s            iptables(delude): %-10u",
-			"", "", config->total_delude);
+	printw("         %-10s               %-10s            iptables(delude): %-10" PRIu64,
+			"", "", st.delude);
 	move(4, 0);
+	printw("Sent: %8.0f pps      Recv: %8.0f pps         In flight: %-6" PRIu64 "  ETA: %-10s",
+			pps_sent, pps_recv, st.in_flight, eta_str);
+	move(5, 0);
 	printw("%3u%% [%s]", percent, bar_str);
 
+	display_history(header_size, 0, num_cols, num_rows - header_size - 2);
 
-	display_history(header_size, 0, num_cols, 0);
+	pthread_mutex_lock(&ring_lock);
+	move(num_rows - 1, 0);
+	clrtoeol();
+	attron(A_BOLD | COLOR_PAIR(2));
+	printw("%s", message);
+	attroff(A_BOLD | COLOR_PAIR(2));
+	pthread_mutex_unlock(&ring_lock);
 
 	refresh();
-
-	pthread_mutex_unlock(&console_lock);
 }
 
 void OutputCurses::display_history(int top, int left, int width, int rows) {
+	ScanRecord recent[HISTORY_SIZE];
+	char flags[5], opts[5], addr[16];
+	uint32_t count;
 	int attr;
 
+	if(rows <= 0) {
+		return;
+	}
+	if(rows > (int)HISTORY_SIZE) {
+		rows = HISTORY_SIZE;
+	}
+
+	/* Copy the newest records out of the ring so the lock is held briefly */
+	pthread_mutex_lock(&ring_lock);
+	count = history_count < (uint32_t)rows ? history_count : rows;
+	for(uint32_t i = 0; i < count; i++) {
+		recent[i] = history[(history_count - count + i) % HISTORY_SIZE];
+	}
+	pthread_mutex_unlock(&ring_lock);
+
 	move(top, left);
 	attron(A_BOLD);
 	printw("%-18s  %15s  %13s  %-10s  %-10s  %s", "IP Address", "Response Time", "Window Size", "TCP Flags", "TCP Options", "Scan Result");
 	attroff(A_BOLD);
 
-	list<Scan>::iterator iter =  scan_history.begin();
-	while(iter != scan_history.end()) {
-		Scan& s = *iter;
+	for(uint32_t i = 0; i < count; i++) {
+		ScanRecord& r = recent[i];
 
 		move(++top, left);
-		switch(s.get_result()) {
+		switch(r.result) {
 			case TARPIT:
 			case LABREA:
 			case IPTABLES:
@@ -141,37 +224,29 @@ void OutputCurses::display_history(int top, int left, int width, int rows) {
 		if(attr) {
 			attron(attr);
 		}
+		inet_ntop(AF_INET, &r.addr, addr, sizeof(addr));
 		printw("%-18s  %15u  %10u       %-6s      %-6s     %-25s",
-				s.address_to_string(),
-				s.response_time,
-				s.window_size,
-				s.flags_to_string(),
-				s.options_to_string(),
-				s.result_to_string());
+				addr,
+				r.response_time,
+				r.window_size,
+				scan_flags_to_string(r.flags, flags),
+				scan_options_to_string(r.options, opts),
+				scan_result_to_string(r.result));
 		if(attr) {
 			attroff(attr);
 		}
-
-		iter++;
 	}
 }
 
+/* Messages are drawn by the render thread on its next frame */
 void OutputCurses::output_message(const char* f, ...) {
 	va_list ap;
-	char buffer[100];
-	int num_rows, num_cols;
 
+	pthread_mutex_lock(&ring_lock);
 	va_start(ap, f);
-	vsnprintf(buffer, 100, f, ap);
+	vsnprintf(message, sizeof(message), f, ap);
 	va_end(ap);
-
-	getmaxyx(stdscr, num_rows, num_cols);
-	move(num_rows - 1, 0);
-
-	attron(A_BOLD | COLOR_PAIR(2));
-	printw("%s\n", buffer);
-	attroff(A_BOLD | COLOR_PAIR(2));
-	refresh();
+	pthread_mutex_unlock(&ring_lock);
 }
 
 #endif /* HAVE_CURSES */
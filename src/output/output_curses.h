@@ -25,20 +25,42 @@
 
 #include <string>
 #include <pthread.h>
+#include <sys/time.h>
 
 #include "../output.h"
 
+/* Progress dashboard. output_scan() only records the result in a small ring;
+   all drawing happens on a separate thread at a fixed frame rate so the
+   scanners never wait on the terminal. */
 class OutputCurses: public Output {
 	public:
 		OutputCurses(const DegreaserConfig*);
 		~OutputCurses();
 
-		void output_scan(Scan*);
+		void output_scan(const ScanRecord& r);
 		void output_message(const char* f, ...);
 	private:
-		pthread_mutex_t console_lock;
-		list<Scan> scan_history;
+		const static uint32_t HISTORY_SIZE = 256;
+		const static uint32_t FRAME_INTERVAL_US = 100000;	/* 10 frames per second */
 
+		pthread_mutex_t ring_lock;
+		ScanRecord history[HISTORY_SIZE];
+		uint32_t history_count;
+		char message[100];
+
+		pthread_t render_tid;
+		bool running;
+
+		struct timeval last_frame;
+		uint64_t last_sent;
+		uint64_t last_recv;
+		uint64_t last_scans;
+		double pps_sent;
+		double pps_recv;
+		double scan_rate;
+
+		static void* render_thread(void* arg);
+		void render();
 		void display_history(int top, int left, int width, int rows);
 };
 
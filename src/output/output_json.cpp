@@ -0,0 +1,216 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+
+#include "output_json.h"
+#include "../scan_record.h"
+
+/* Two ASCII digits for every value 0-99, so integers are converted two
+   digits per division */
+static const char digit_pairs[201] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* Append a string literal */
+#define PUT(p, s) do { memcpy(p, s, sizeof(s) - 1); p += sizeof(s) - 1; } while(0)
+
+static char* put_uint(char* p, uint32_t v) {
+	char buf[10];
+	char* end = buf + sizeof(buf);
+	char* q = end;
+
+	while(v >= 100) {
+		uint32_t i = (v % 100) * 2;
+		v /= 100;
+		q -= 2;
+		q[0] = digit_pairs[i];
+		q[1] = digit_pairs[i + 1];
+	}
+	if(v >= 10) {
+		q -= 2;
+		q[0] = digit_pairs[v * 2];
+		q[1] = digit_pairs[v * 2 + 1];
+	} else {
+		*--q = '0' + v;
+	}
+
+	memcpy(p, q, end - q);
+	return p + (end - q);
+}
+
+static char* put_str(char* p, const char* s) {
+	while(*s) {
+		*p++ = *s++;
+	}
+	return p;
+}
+
+OutputJSON::OutputJSON(const DegreaserConfig* c, string fn) : Output(c), filename(fn) {
+	if(filename == "-") {
+		fd = STDOUT_FILENO;
+	} else {
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd < 0) {
+			fprintf(stderr, "error: failed to open output file '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Dotted quad text for every octet value, with its length in the last byte */
+	for(int i = 0; i < 256; i++) {
+		char* end = put_uint(octets[i], i);
+		octets[i][3] = end - octets[i];
+	}
+
+	chunks = new char[CHUNK_COUNT * CHUNK_SIZE];
+	chunk = 0;
+	used = 0;
+}
+
+OutputJSON::~OutputJSON() {
+	write_chunks();
+	if(fd != STDOUT_FILENO) {
+		close(fd);
+	}
+	delete[] chunks;
+}
+
+void OutputJSON::output_scan(const ScanRecord& r) {
+	const uint8_t* a = (const uint8_t*)&r.addr;
+	const uint8_t* router = (const uint8_t*)&r.icmp_router;
+	char* start = chunks + chunk * CHUNK_SIZE + used;
+	char* p = start;
+	char flags[5];
+	char opts[5];
+	char send_opts[5];
+
+	if(failed) {
+		return;
+	}
+
+	PUT(p, "{\"addr\":\"");
+	for(int i = 0; i < 4; i++) {
+		memcpy(p, octets[a[i]], 3);
+		p += octets[a[i]][3];
+		*p++ = '.';
+	}
+	p--;
+	PUT(p, "\",\"result\":\"");
+	p = put_str(p, scan_result_to_string(r.result));
+	PUT(p, "\",\"response_time\":");
+	p = put_uint(p, r.response_time);
+	PUT(p, ",\"window_size\":");
+	p = put_uint(p, r.window_size);
+	PUT(p, ",\"flags\":\"");
+	p = put_str(p, scan_flags_to_string(r.flags, flags));
+	PUT(p, "\",\"options\":\"");
+	p = put_str(p, scan_options_to_string(r.options, opts));
+	PUT(p, "\",\"timestamp\":");
+	p = put_uint(p, r.timestamp);
+	PUT(p, ",\"src_port\":");
+	p = put_uint(p, r.src_port);
+	PUT(p, ",\"dst_port\":");
+	p = put_uint(p, r.dst_port);
+	PUT(p, ",\"confidence\":");
+	p = put_uint(p, r.confidence);
+	PUT(p, ",\"ttl\":");
+	p = put_uint(p, r.ttl);
+	PUT(p, ",\"send_options\":\"");
+	p = put_str(p, scan_options_to_string(r.send_options, send_opts));
+	PUT(p, "\",\"icmp_router\":\"");
+	for(int i = 0; i < 4; i++) {
+		memcpy(p, octets[router[i]], 3);
+		p += octets[router[i]][3];
+		*p++ = '.';
+	}
+	p--;
+	PUT(p, "\",\"icmp_code\":");
+	p = put_uint(p, r.icmp_code);
+	PUT(p, "}\n");
+
+	used += p - start;
+	if(CHUNK_SIZE - used < MAX_LINE) {
+		/* Move on to the next chunk, writing them all out once they are full */
+		iov[chunk].iov_base = chunks + chunk * CHUNK_SIZE;
+		iov[chunk].iov_len = used;
+		chunk++;
+		used = 0;
+		if(chunk == CHUNK_COUNT) {
+			write_chunks();
+		}
+	}
+}
+
+void OutputJSON::output_message(const char* f, ...) {
+	// Messages don't get written to output file.
+}
+
+void OutputJSON::output_flush() {
+	write_chunks();
+}
+
+void OutputJSON::write_chunks() {
+	struct iovec* v = iov;
+	int count = chunk;
+
+	if(used > 0) {
+		iov[chunk].iov_base = chunks + chunk * CHUNK_SIZE;
+		iov[chunk].iov_len = used;
+		count++;
+	}
+
+	while(count > 0 && !failed) {
+		ssize_t n = writev(fd, v, count);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "error: failed to write to '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+			failed = true;
+			break;
+		}
+
+		/* Skip what was written; pipes and signals can cut a write short */
+		while(count > 0 && (size_t)n >= v->iov_len) {
+			n -= v->iov_len;
+			v++;
+			count--;
+		}
+		if(count > 0) {
+			v->iov_base = (char*)v->iov_base + n;
+			v->iov_len -= n;
+		}
+	}
+
+	chunk = 0;
+	used = 0;
+}
@@ -0,0 +1,59 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef OUTPUT_JSON_H
+#define OUTPUT_JSON_H
+
+#include <string>
+#include <sys/uio.h>
+
+#include "../output.h"
+
+/* Streams every record as one JSON object per line (NDJSON) with the same
+   fields as 'degreaser-read -f json'. Lines are formatted into a ring of
+   chunks that are handed to the kernel with a single writev() when they fill
+   up or the output writer flushes, so stdout, a file or a pipe all work. */
+class OutputJSON : public Output {
+	public:
+		OutputJSON(const DegreaserConfig*, string);
+		~OutputJSON();
+
+		void output_scan(const ScanRecord& r);
+		void output_message(const char* f, ...);
+		void output_flush();
+	private:
+		const static uint32_t CHUNK_COUNT = 16;
+		const static uint32_t CHUNK_SIZE = 65536;
+		const static uint32_t MAX_LINE = 384;	/* Longest possible record line */
+
+		int fd;
+		string filename;
+		char octets[256][4];	/* Text of each address octet, length in [3] */
+		char* chunks;
+		struct iovec iov[CHUNK_COUNT];
+		uint32_t chunk;			/* Chunk being filled */
+		uint32_t used;			/* Bytes used in that chunk */
+
+		void write_chunks();
+};
+
+#endif /* OUTPUT_JSON_H */
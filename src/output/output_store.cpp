@@ -0,0 +1,37 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include "output_store.h"
+#include "../scan_record.h"
+
+OutputStore::OutputStore(const DegreaserConfig* c, ResultStore* s) : Output(c), store(s) { }
+
+OutputStore::~OutputStore() {
+	store->save();
+}
+
+void OutputStore::output_scan(const ScanRecord& r) {
+	store->update(r);
+}
+
+void OutputStore::output_message(const char* f, ...) {
+	// Messages don't go into the store.
+}
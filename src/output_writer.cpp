@@ -0,0 +1,139 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "degreaser.h"
+#include "output_writer.h"
+#include "output.h"
+#include "trace.h"
+#include "probes.h"
+
+OutputWriter::OutputWriter(DegreaserConfig* c) : config(c), queue(QUEUE_SIZE) {
+	running = false;
+	stopping = false;
+	pthread_mutex_init(&message_lock, NULL);
+}
+
+OutputWriter::~OutputWriter() {
+	stop();
+	pthread_mutex_destroy(&message_lock);
+}
+
+void OutputWriter::start() {
+	if(running) {
+		return;
+	}
+	stopping = false;
+	pthread_create(&thread, NULL, writer_thread, this);
+	running = true;
+}
+
+/* Waits for everything already queued to be written out */
+void OutputWriter::stop() {
+	if(!running) {
+		return;
+	}
+	__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	running = false;
+}
+
+void OutputWriter::push(const ScanRecord& r) {
+	/* Backpressure: only wait when the writer has fallen a full queue behind */
+	while(!queue.try_push(r)) {
+		sched_yield();
+	}
+}
+
+void OutputWriter::message(const char* f, ...) {
+	char buf[256];
+	va_list args;
+
+	va_start(args, f);
+	vsnprintf(buf, sizeof(buf), f, args);
+	va_end(args);
+
+	pthread_mutex_lock(&message_lock);
+	messages.push_back(buf);
+	pthread_mutex_unlock(&message_lock);
+}
+
+void* OutputWriter::writer_thread(void* arg) {
+	OutputWriter* w = (OutputWriter*)arg;
+
+	trace_attach("output writer");
+
+	for(;;) {
+		bool stopping = __atomic_load_n(&w->stopping, __ATOMIC_ACQUIRE);
+		if(0 == w->drain()) {
+			/* Only exit once the queue has been seen empty after the stop
+			   request, so nothing pushed before stop() is lost. */
+			if(stopping) {
+				break;
+			}
+			usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t OutputWriter::drain() {
+	list<Output*>::iterator iter;
+	list<string> pending;
+	uint32_t count = 0;
+	ScanRecord r;
+
+	/* Messages are rare; take them all at once */
+	pthread_mutex_lock(&message_lock);
+	pending.swap(messages);
+	pthread_mutex_unlock(&message_lock);
+	for(list<string>::iterator m = pending.begin(); m != pending.end(); ++m) {
+		for(iter = config->outputs.begin(); iter != config->outputs.end(); ++iter) {
+			(*iter)->output_message("%s", m->c_str());
+		}
+	}
+
+	while(count < BATCH_SIZE && queue.try_pop(&r)) {
+		if(count == 0) {
+			TRACE_BEGIN(TRACE_OUTPUT);
+		}
+		for(iter = config->outputs.begin(); iter != config->outputs.end(); ++iter) {
+			DEGREASER_PROBE2(output_dispatch, r.addr, r.result);
+			(*iter)->output_scan(r);
+		}
+		count++;
+	}
+
+	if(count > 0) {
+		for(iter = config->outputs.begin(); iter != config->outputs.end(); ++iter) {
+			(*iter)->output_flush();
+		}
+		TRACE_END(TRACE_OUTPUT);
+	}
+
+	return count + pending.size();
+}
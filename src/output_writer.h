@@ -0,0 +1,70 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <pthread.h>
+#include <list>
+#include <string>
+
+#include "degreaser.h"
+#include "mpsc_queue.h"
+#include "scan_record.h"
+
+/* Decouples the scanning threads from the output modules. Scanners hand
+   the record of each finished scan to push(), which copies it into the
+   queue and only blocks when the queue is full. A single writer thread
+   drains the queue in batches, runs every output module on each record and
+   flushes the outputs once per batch. Status messages from message() are
+   passed on by the same thread, so output modules only ever run on the
+   writer thread. */
+class OutputWriter {
+	public:
+		OutputWriter(DegreaserConfig* c);
+		~OutputWriter();
+
+		void start();
+		void stop();
+
+		void push(const ScanRecord& r);
+
+		/* Queue a printf style status message for every output's
+		   output_message(). Called from any thread. */
+		void message(const char* f, ...);
+
+	private:
+		DegreaserConfig* config;
+		MPSCQueue<ScanRecord> queue;
+		pthread_mutex_t message_lock;
+		list<string> messages;
+		pthread_t thread;
+		bool running;
+		bool stopping;
+
+		static void* writer_thread(void* arg);
+		uint32_t drain();
+
+		const static uint32_t QUEUE_SIZE = 65536;
+		const static uint32_t BATCH_SIZE = 4096;
+};
+
+#endif /* OUTPUT_WRITER_H */
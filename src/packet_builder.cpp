@@ -0,0 +1,113 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "packet_builder.h"
+#include "prng.h"
+
+#define IP_DEFAULT_TTL		64
+#define IP_FLAG_DF			0x4000
+
+static inline void put16(uint8_t* p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t checksum_add(uint32_t sum, const uint8_t* data, size_t len) {
+	while(len > 1) {
+		sum += (data[0] << 8) | data[1];
+		data += 2;
+		len -= 2;
+	}
+	if(len) {
+		sum += data[0] << 8;
+	}
+	return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum) {
+	while(sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum;
+}
+
+size_t packet_build_tcp(uint8_t* buf, size_t size, const TcpPacketSpec& spec) {
+	size_t tcp_len = 20 + spec.options_len + spec.payload_len;
+	size_t total = 20 + tcp_len;
+	uint8_t* ip = buf;
+	uint8_t* tcp = buf + 20;
+	uint8_t pseudo[12];
+
+	if(total > size || total > 0xffff || spec.options_len > 40 || spec.options_len % 4) {
+		return 0;
+	}
+
+	/* IPv4 header */
+	ip[0] = 0x45;
+	ip[1] = 0;
+	put16(ip + 2, total);
+	put16(ip + 4, spec.ip_id);
+	put16(ip + 6, IP_FLAG_DF);
+	ip[8] = IP_DEFAULT_TTL;
+	ip[9] = IPPROTO_TCP;
+	put16(ip + 10, 0);
+	memcpy(ip + 12, &spec.src_addr, 4);
+	memcpy(ip + 16, &spec.dst_addr, 4);
+	put16(ip + 10, checksum_fold(checksum_add(0, ip, 20)));
+
+	/* TCP header */
+	put16(tcp, spec.src_port);
+	put16(tcp + 2, spec.dst_port);
+	put32(tcp + 4, spec.seq);
+	put32(tcp + 8, spec.ack);
+	tcp[12] = ((20 + spec.options_len) / 4) << 4;
+	tcp[13] = spec.flags;
+	put16(tcp + 14, spec.window);
+	put16(tcp + 16, 0);
+	put16(tcp + 18, 0);
+	if(spec.options_len) {
+		memcpy(tcp + 20, spec.options, spec.options_len);
+	}
+	if(spec.payload_len) {
+		memcpy(tcp + 20 + spec.options_len, spec.payload, spec.payload_len);
+	}
+
+	/* Checksum over the pseudo header and segment */
+	memcpy(pseudo, &spec.src_addr, 4);
+	memcpy(pseudo + 4, &spec.dst_addr, 4);
+	pseudo[8] = 0;
+	pseudo[9] = IPPROTO_TCP;
+	put16(pseudo + 10, tcp_len);
+	put16(tcp + 16, checksum_fold(checksum_add(checksum_add(0, pseudo, 12), tcp, tcp_len)));
+
+	return total;
+}
@@ -0,0 +1,54 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PACKET_BUILDER_H
+#define PACKET_BUILDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Builds IPv4/TCP packets directly into a caller supplied buffer, for
+   sending on a raw IPPROTO_RAW socket. Header defaults (TTL 64, DF set,
+   window 5840) match what libcrafter puts in the packets it builds, so
+   targets see the same probes from either send path. */
+
+#define PACKET_MAX_SIZE		(20 + 60 + 1500)
+
+struct TcpPacketSpec {
+	uint32_t src_addr;			/* Network byte order */
+	uint32_t dst_addr;			/* Network byte order */
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint16_t ip_id;
+	uint32_t seq;
+	uint32_t ack;
+	uint8_t flags;
+	uint16_t window;
+	const uint8_t* options;		/* Already padded to a multiple of 4 bytes */
+	uint8_t options_len;
+	const uint8_t* payload;
+	uint16_t payload_len;
+};
+
+/* Returns the packet length, or 0 if it does not fit in size bytes */
+size_t packet_build_tcp(uint8_t* buf, size_t size, const TcpPacketSpec& spec);
+
+#endif /* PACKET_BUILDER_H */
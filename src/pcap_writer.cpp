@@ -0,0 +1,370 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+#include "degreaser.h"
+#include "pcap_writer.h"
+
+struct PcapBuffer {
+	uint32_t used;
+	time_t first;			/* Timestamp of the first packet */
+	uint8_t data[1];
+};
+
+/* Classic pcap file and record headers */
+struct PcapFileHeader {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct PcapRecordHeader {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/* pcapng blocks. Only what's needed for a single raw IP interface. */
+struct PcapngSectionHeader {
+	uint32_t type;
+	uint32_t length;
+	uint32_t byte_order;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int64_t section_length;
+	uint32_t length2;
+} __attribute__((packed));
+
+struct PcapngInterfaceDescription {
+	uint32_t type;
+	uint32_t length;
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+	uint32_t length2;
+};
+
+struct PcapngEnhancedPacket {
+	uint32_t type;
+	uint32_t length;
+	uint32_t interface_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static __thread PcapBuffer* thread_buffer = NULL;
+
+PcapWriter::PcapWriter(string fn, PcapFormat fmt) : filename(fn), format(fmt), full(QUEUE_SIZE) {
+	max_bytes = 0;
+	max_seconds = 0;
+	running = false;
+	failed = false;
+	fd = -1;
+	file_index = 0;
+	file_bytes = 0;
+	header_bytes = 0;
+	file_opened = 0;
+	pthread_mutex_init(&free_lock, NULL);
+}
+
+PcapWriter::~PcapWriter() {
+	stop();
+	for(vector<PcapBuffer*>::iterator iter = free_buffers.begin(); iter != free_buffers.end(); ++iter) {
+		free(*iter);
+	}
+	pthread_mutex_destroy(&free_lock);
+}
+
+void PcapWriter::set_rotation(uint64_t bytes, uint32_t seconds) {
+	max_bytes = bytes;
+	max_seconds = seconds;
+}
+
+bool PcapWriter::start() {
+	if(!open_file()) {
+		return false;
+	}
+	running = true;
+	pthread_create(&tid, NULL, writer_thread, this);
+	return true;
+}
+
+void PcapWriter::stop() {
+	if(!running) {
+		return;
+	}
+	flush_thread();
+	__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+	pthread_join(tid, NULL);
+	close(fd);
+	fd = -1;
+}
+
+PcapBuffer* PcapWriter::get_buffer() {
+	PcapBuffer* b = NULL;
+
+	pthread_mutex_lock(&free_lock);
+	if(!free_buffers.empty()) {
+		b = free_buffers.back();
+		free_buffers.pop_back();
+	}
+	pthread_mutex_unlock(&free_lock);
+
+	if(!b) {
+		b = (PcapBuffer*)malloc(sizeof(PcapBuffer) + BUFFER_SIZE);
+		if(!b) {
+			fprintf(stderr, "error: failed to allocate pcap buffer\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	b->used = 0;
+	return b;
+}
+
+void PcapWriter::submit(PcapBuffer* b) {
+	while(!full.try_push(b)) {
+		sched_yield();
+	}
+}
+
+void PcapWriter::write_packet(const uint8_t* data, uint32_t len, const struct timeval& ts) {
+	write_packet(data, len, len, ts);
+}
+
+void PcapWriter::write_packet(const uint8_t* data, uint32_t caplen, uint32_t len, const struct timeval& ts) {
+	if(caplen > 65535) {
+		caplen = 65535;
+	}
+	uint32_t padded = (caplen + 3) & ~3;
+	uint32_t record_len;
+
+	if(format == PCAP_FORMAT_PCAPNG) {
+		record_len = sizeof(PcapngEnhancedPacket) + padded + sizeof(uint32_t);
+	} else {
+		record_len = sizeof(PcapRecordHeader) + caplen;
+	}
+
+	/* A buffer is handed over once full or once it has held packets for a
+	   while, so a slow capture still reaches the file soon enough */
+	if(!thread_buffer) {
+		thread_buffer = get_buffer();
+	} else if(thread_buffer->used + record_len > BUFFER_SIZE || ts.tv_sec - thread_buffer->first >= (time_t)MAX_BUFFER_AGE) {
+		submit(thread_buffer);
+		thread_buffer = get_buffer();
+	}
+	if(thread_buffer->used == 0) {
+		thread_buffer->first = ts.tv_sec;
+	}
+
+	uint8_t* ptr = thread_buffer->data + thread_buffer->used;
+	if(format == PCAP_FORMAT_PCAPNG) {
+		uint64_t usec = (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+		PcapngEnhancedPacket* epb = (PcapngEnhancedPacket*)ptr;
+		epb->type = 6;
+		epb->length = record_len;
+		epb->interface_id = 0;
+		epb->ts_high = usec >> 32;
+		epb->ts_low = usec & 0xffffffff;
+		epb->caplen = caplen;
+		epb->len = len;
+		ptr += sizeof(PcapngEnhancedPacket);
+		memcpy(ptr, data, caplen);
+		memset(ptr + caplen, 0, padded - caplen);
+		memcpy(ptr + padded, &record_len, sizeof(uint32_t));
+	} else {
+		PcapRecordHeader* rec = (PcapRecordHeader*)ptr;
+		rec->ts_sec = ts.tv_sec;
+		rec->ts_usec = ts.tv_usec;
+		rec->caplen = caplen;
+		rec->len = len;
+		memcpy(ptr + sizeof(PcapRecordHeader), data, caplen);
+	}
+	thread_buffer->used += record_len;
+}
+
+void PcapWriter::flush_thread() {
+	if(thread_buffer) {
+		submit(thread_buffer);
+		thread_buffer = NULL;
+	}
+}
+
+void PcapWriter::flush_thread_if_old() {
+	if(thread_buffer && thread_buffer->used > 0 && time(NULL) - thread_buffer->first >= (time_t)MAX_BUFFER_AGE) {
+		flush_thread();
+	}
+}
+
+void* PcapWriter::writer_thread(void* arg) {
+	PcapWriter* w = (PcapWriter*)arg;
+	PcapBuffer* b;
+
+	for(;;) {
+		bool running = __atomic_load_n(&w->running, __ATOMIC_ACQUIRE);
+		if(w->full.try_pop(&b)) {
+			w->write_buffer(b);
+			pthread_mutex_lock(&w->free_lock);
+			w->free_buffers.push_back(b);
+			pthread_mutex_unlock(&w->free_lock);
+		} else if(!running) {
+			break;
+		} else {
+			/* Time based rotation does not wait for packets */
+			if(!w->failed) {
+				w->rotate_if_due(0);
+			}
+			usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+/* Opens the next capture file and writes its file header. With rotation
+   enabled, files are numbered: capture.pcap becomes capture.0000.pcap,
+   capture.0001.pcap, ... */
+bool PcapWriter::open_file() {
+	string fn = filename;
+	char suffix[16];
+
+	if(max_bytes || max_seconds) {
+		size_t dot = filename.rfind('.');
+		size_t slash = filename.rfind('/');
+		snprintf(suffix, sizeof(suffix), ".%04u", file_index);
+		if(dot == string::npos || (slash != string::npos && dot < slash)) {
+			fn = filename + suffix;
+		} else {
+			fn = filename.substr(0, dot) + suffix + filename.substr(dot);
+		}
+	}
+	file_index++;
+
+	if(fd >= 0) {
+		close(fd);
+	}
+	fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "error: failed to open pcap file '%s'. Reason: %s\n", fn.c_str(), strerror(errno));
+		return false;
+	}
+	file_name = fn;
+	file_bytes = 0;
+	file_opened = time(NULL);
+
+	if(format == PCAP_FORMAT_PCAPNG) {
+		PcapngSectionHeader shb;
+		PcapngInterfaceDescription idb;
+
+		shb.type = 0x0a0d0d0a;
+		shb.length = shb.length2 = sizeof(shb);
+		shb.byte_order = 0x1a2b3c4d;
+		shb.version_major = 1;
+		shb.version_minor = 0;
+		shb.section_length = -1;
+		write_all(&shb, sizeof(shb));
+
+		idb.type = 1;
+		idb.length = idb.length2 = sizeof(idb);
+		idb.linktype = LINKTYPE_RAW;
+		idb.reserved = 0;
+		idb.snaplen = 65535;
+		write_all(&idb, sizeof(idb));
+	} else {
+		PcapFileHeader hdr;
+
+		hdr.magic = 0xa1b2c3d4;
+		hdr.version_major = 2;
+		hdr.version_minor = 4;
+		hdr.thiszone = 0;
+		hdr.sigfigs = 0;
+		hdr.snaplen = 65535;
+		hdr.linktype = LINKTYPE_RAW;
+		write_all(&hdr, sizeof(hdr));
+	}
+	header_bytes = file_bytes;
+
+	return true;
+}
+
+/* Moves on to the next file if the current one would grow past max_bytes
+   with incoming more bytes, or is older than max_seconds */
+bool PcapWriter::rotate_if_due(uint32_t incoming) {
+	if((max_bytes && file_bytes + incoming > max_bytes && file_bytes > header_bytes) ||
+			(max_seconds && time(NULL) - file_opened >= (time_t)max_seconds)) {
+		if(!open_file()) {
+			fprintf(stderr, "error: pcap rotation failed, packets will be discarded\n");
+			failed = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+void PcapWriter::write_buffer(PcapBuffer* b) {
+	if(failed || !rotate_if_due(b->used)) {
+		return;
+	}
+
+	write_all(b->data, b->used);
+}
+
+void PcapWriter::write_all(const void* data, size_t len) {
+	const uint8_t* ptr = (const uint8_t*)data;
+
+	if(fd < 0 || failed) {
+		return;
+	}
+
+	while(len > 0) {
+		ssize_t n = write(fd, ptr, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "error: failed to write to pcap file '%s', packets will be discarded. Reason: %s\n",
+					file_name.c_str(), strerror(errno));
+			failed = true;
+			return;
+		}
+		ptr += n;
+		len -= n;
+		file_bytes += n;
+	}
+}
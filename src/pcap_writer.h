@@ -0,0 +1,105 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PCAP_WRITER_H
+#define PCAP_WRITER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "mpsc_queue.h"
+
+using namespace std;
+
+enum PcapFormat { PCAP_FORMAT_PCAP, PCAP_FORMAT_PCAPNG };
+
+struct PcapBuffer;
+
+/* Background packet capture writer. Each thread formats its packets into a
+   private buffer; full buffers, and buffers holding packets older than
+   MAX_BUFFER_AGE seconds, are handed to a writer thread that writes them out
+   in large blocks, so scanners never wait on capture I/O or on each other.
+   Files can be rotated by size and/or age. Packets from different threads
+   are not interleaved in timestamp order. */
+class PcapWriter {
+	public:
+		PcapWriter(string filename, PcapFormat format);
+		~PcapWriter();
+
+		/* Rotate once the current file reaches this many bytes or seconds (0 = never) */
+		void set_rotation(uint64_t max_bytes, uint32_t max_seconds);
+
+		bool start();
+		void stop();
+
+		/* Queue a raw IPv4 packet. Called from any thread. caplen may be less
+		   than len if the packet was truncated before it got here. */
+		void write_packet(const uint8_t* data, uint32_t len, const struct timeval& ts);
+		void write_packet(const uint8_t* data, uint32_t caplen, uint32_t len, const struct timeval& ts);
+
+		/* Hand the calling thread's partially filled buffer to the writer.
+		   Threads must call this before they exit. */
+		void flush_thread();
+
+		/* The same, but only once the buffer has reached MAX_BUFFER_AGE.
+		   For threads about to wait without sending anything. */
+		void flush_thread_if_old();
+
+	private:
+		string filename;
+		PcapFormat format;
+		uint64_t max_bytes;
+		uint32_t max_seconds;
+
+		MPSCQueue<PcapBuffer*> full;
+		pthread_mutex_t free_lock;
+		vector<PcapBuffer*> free_buffers;
+
+		pthread_t tid;
+		bool running;
+		bool failed;				/* A write failed; the rest is discarded */
+
+		int fd;
+		string file_name;			/* Name of the current file */
+		uint32_t file_index;
+		uint64_t file_bytes;
+		uint64_t header_bytes;
+		time_t file_opened;
+
+		PcapBuffer* get_buffer();
+		void submit(PcapBuffer* b);
+
+		static void* writer_thread(void* arg);
+		bool open_file();
+		void write_buffer(PcapBuffer* b);
+		bool rotate_if_due(uint32_t incoming);
+		void write_all(const void* data, size_t len);
+
+		const static uint32_t BUFFER_SIZE = 256 * 1024;
+		const static uint32_t MAX_BUFFER_AGE = 1;
+		const static uint32_t QUEUE_SIZE = 1024;
+		const static uint16_t LINKTYPE_RAW = 101;
+};
+
+#endif /* PCAP_WRITER_H */
@@ -0,0 +1,98 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "port_allocator.h"
+#include "prng.h"
+
+PortAllocator::PortAllocator(uint16_t mn, uint16_t mx) {
+	min = mn;
+	max = mx;
+	used = 0;
+	words = (size() + 63) / 64;
+	bitmap = (uint64_t*)calloc(words, sizeof(uint64_t));
+
+	/* Mark the bits past the end of the window as taken */
+	uint32_t tail = size() % 64;
+	if(tail) {
+		bitmap[words - 1] = ~0ULL << tail;
+	}
+}
+
+PortAllocator::~PortAllocator() {
+	free(bitmap);
+}
+
+uint32_t PortAllocator::size() const {
+	return (uint32_t)max - min + 1;
+}
+
+uint32_t PortAllocator::in_use() const {
+	return __atomic_load_n(&used, __ATOMIC_RELAXED);
+}
+
+/* Claim the lowest free bit in word index, if there is one */
+bool PortAllocator::try_acquire(uint32_t index, uint32_t* bit_index) {
+	uint64_t word = __atomic_load_n(&bitmap[index], __ATOMIC_RELAXED);
+
+	while(word != ~0ULL) {
+		uint64_t bit = ~word & (word + 1);
+		if(__atomic_compare_exchange_n(&bitmap[index], &word, word | bit, true,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			*bit_index = __builtin_ctzll(bit);
+			return true;
+		}
+	}
+	return false;
+}
+
+uint16_t PortAllocator::acquire() {
+	uint32_t bit;
+
+	for(;;) {
+		/* Start at a random word so ports are spread over the window and
+		   threads do not all contend on the same word */
+		uint32_t start = prng_range(0, words);
+		for(uint32_t i = 0; i < words; i++) {
+			uint32_t index = (start + i) % words;
+			if(try_acquire(index, &bit)) {
+				__atomic_add_fetch(&used, 1, __ATOMIC_RELAXED);
+				return min + index * 64 + bit;
+			}
+		}
+
+		/* Every port is in flight; wait for a scan to finish */
+		sched_yield();
+	}
+}
+
+void PortAllocator::release(uint16_t port) {
+	uint32_t offset = port - min;
+
+	if(port < min || port > max) {
+		return;
+	}
+	__atomic_and_fetch(&bitmap[offset / 64], ~(1ULL << (offset % 64)), __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&used, 1, __ATOMIC_RELAXED);
+}
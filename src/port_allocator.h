@@ -0,0 +1,57 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PORT_ALLOCATOR_H
+#define PORT_ALLOCATOR_H
+
+#include <stdint.h>
+
+/* Hands out source ports from [min, max] so that no two scans in flight
+   ever share one. Every probe goes out from the same address to the same
+   destination port, so a unique source port is enough to keep each
+   connection 4-tuple unique and replies from being matched to the wrong
+   scan. Ports are tracked in a bitmap updated with atomic operations, so
+   acquiring and releasing never takes a lock. */
+class PortAllocator {
+	public:
+		PortAllocator(uint16_t min, uint16_t max);
+		~PortAllocator();
+
+		/* Returns a free port, waiting for one if the whole window is in use */
+		uint16_t acquire();
+
+		/* Returns a port to the pool. Call once the scan's RST has been sent. */
+		void release(uint16_t port);
+
+		uint32_t size() const;
+		uint32_t in_use() const;
+
+	private:
+		bool try_acquire(uint32_t index, uint32_t* bit_index);
+
+		uint16_t min;
+		uint16_t max;
+		uint32_t words;
+		uint32_t used;
+		uint64_t* bitmap;
+};
+
+#endif /* PORT_ALLOCATOR_H */
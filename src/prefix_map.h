@@ -0,0 +1,145 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef PREFIX_MAP_H
+#define PREFIX_MAP_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <map>
+
+using namespace std;
+
+/* Sampling state of one /24. While active, only one address in every rate
+   is let through; a rate of 0 lets none through. Samples are counted when
+   they are handed out, not when their result comes in, so a slow sample
+   can't let the addresses behind it through as well. */
+struct PrefixSample {
+	bool active;
+	uint32_t sampled;			/* Addresses let through while active */
+	uint32_t skipped;
+
+	bool skip(uint16_t rate) {
+		if(rate == 0 || (sampled + skipped) % rate != 0) {
+			skipped++;
+			return true;
+		}
+		sampled++;
+		return false;
+	}
+};
+
+/* Per-/24 state, spread over a number of independently locked shards so
+   that scanner threads rarely contend. T is a plain struct with a prefix
+   (address >> 8, host byte order) and a PrefixSample named sample; new
+   entries start out zeroed. */
+template<class T>
+class PrefixMap {
+	public:
+		static const int SHARDS = 64;
+
+		PrefixMap() {
+			for(int i = 0; i < SHARDS; i++) {
+				pthread_mutex_init(&shards[i].lock, NULL);
+			}
+		}
+
+		~PrefixMap() {
+			for(int i = 0; i < SHARDS; i++) {
+				pthread_mutex_destroy(&shards[i].lock);
+			}
+		}
+
+		/* Returns true if addr (network byte order) should not be probed
+		   because its /24 is being sampled */
+		bool should_skip(uint32_t addr, uint16_t rate) {
+			uint32_t prefix = ntohl(addr) >> 8;
+			Shard* shard = shard_for(prefix);
+			bool skip = false;
+
+			pthread_mutex_lock(&shard->lock);
+			typename map<uint32_t, T>::iterator iter = shard->entries.find(prefix);
+			if(iter != shard->entries.end() && iter->second.sample.active) {
+				skip = iter->second.sample.skip(rate);
+			}
+			pthread_mutex_unlock(&shard->lock);
+
+			return skip;
+		}
+
+		/* Lock the shard of addr's /24 (network byte order) and return its
+		   entry, created if need be. Release it with unlock(). */
+		T* lock(uint32_t addr) {
+			uint32_t prefix = ntohl(addr) >> 8;
+			Shard* shard = shard_for(prefix);
+
+			pthread_mutex_lock(&shard->lock);
+			T& entry = shard->entries[prefix];
+			entry.prefix = prefix;
+			return &entry;
+		}
+
+		void unlock(const T* entry) {
+			pthread_mutex_unlock(&shard_for(entry->prefix)->lock);
+		}
+
+		/* Call fn on every entry, each shard locked while its entries are
+		   visited */
+		void for_each(void (*fn)(const T&, void*), void* arg) {
+			for(int i = 0; i < SHARDS; i++) {
+				pthread_mutex_lock(&shards[i].lock);
+				for(typename map<uint32_t, T>::iterator iter = shards[i].entries.begin(); iter != shards[i].entries.end(); iter++) {
+					fn(iter->second, arg);
+				}
+				pthread_mutex_unlock(&shards[i].lock);
+			}
+		}
+
+		/* Number of /24s being sampled */
+		uint32_t sampled_prefixes() {
+			uint32_t count = 0;
+			for_each(count_active, &count);
+			return count;
+		}
+
+	private:
+		struct Shard {
+			pthread_mutex_t lock;
+			map<uint32_t, T> entries;
+		};
+
+		Shard* shard_for(uint32_t prefix) {
+			/* Neighbouring /24s land in different shards */
+			return &shards[(prefix * 2654435761u) >> 26];
+		}
+
+		static void count_active(const T& entry, void* arg) {
+			if(entry.sample.active) {
+				(*(uint32_t*)arg)++;
+			}
+		}
+
+		Shard shards[SHARDS];
+};
+
+#endif /* PREFIX_MAP_H */
@@ -0,0 +1,114 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "prefix_tracker.h"
+#include "scan_record.h"
+
+enum PrefixMode {	PREFIX_LEARNING,	/* Probing every address, counting verdicts */
+					PREFIX_SPARSE,		/* Known tarpit range, sampling only */
+					PREFIX_MIXED };		/* Disagreeing results seen, always probe */
+
+static bool is_tarpit(int result) {
+	return result == LABREA || result == IPTABLES || result == TARPIT || result == DELUDE;
+}
+
+PrefixTracker::PrefixTracker(uint16_t t, uint16_t s) {
+	threshold = t;
+	sample_rate = s ? s : 1;
+}
+
+PrefixTracker::~PrefixTracker() { }
+
+bool PrefixTracker::should_skip(uint32_t addr) {
+	/* Keep probing one address in every sample_rate so a change in the
+	   prefix is still noticed */
+	return prefixes.should_skip(addr, sample_rate);
+}
+
+void PrefixTracker::record(uint32_t addr, int result, uint16_t window_size, uint8_t options, uint8_t ttl) {
+	/* Addresses with nothing behind them say nothing about the prefix */
+	if(result == NO_RESPONSE || result == DRY_RUN || result == NOT_SCANNED) {
+		return;
+	}
+
+	PrefixState* p = prefixes.lock(addr);
+	p->probed++;
+
+	if(p->state != PREFIX_MIXED) {
+		bool same = p->consistent > 0 && p->result == result && p->window_size == window_size
+				&& p->options == options && p->ttl == ttl;
+
+		if(!is_tarpit(result) || (p->consistent > 0 && !same)) {
+			/* Something real or a different tarpit lives here too */
+			p->state = PREFIX_MIXED;
+		} else {
+			if(p->consistent == 0) {
+				p->result = result;
+				p->window_size = window_size;
+				p->options = options;
+				p->ttl = ttl;
+			}
+			p->consistent++;
+			if(p->consistent >= threshold) {
+				p->state = PREFIX_SPARSE;
+			}
+		}
+		p->sample.active = (p->state == PREFIX_SPARSE);
+	}
+	prefixes.unlock(p);
+}
+
+uint32_t PrefixTracker::tarpit_ranges() {
+	return prefixes.sampled_prefixes();
+}
+
+static void write_range(const PrefixState& p, void* arg) {
+	char opts[5];
+
+	if(p.state != PREFIX_SPARSE) {
+		return;
+	}
+	fprintf((FILE*)arg, "%u.%u.%u.0/24,%s,%u,%s,%u,%u,%u,%u\n",
+			(p.prefix >> 16) & 0xff, (p.prefix >> 8) & 0xff, p.prefix & 0xff,
+			scan_result_to_string(p.result), p.window_size,
+			scan_options_to_string(p.options, opts), p.ttl,
+			p.consistent, p.probed, p.sample.skipped);
+}
+
+bool PrefixTracker::write_report(const char* filename) {
+	FILE* fd = fopen(filename, "w");
+
+	if(!fd) {
+		fprintf(stderr, "error: Failed to open tarpit range report '%s'. Reason: %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	fprintf(fd, "Prefix,Scan Result,Window Size,TCP Options,TTL,Tarpit Verdicts,Probed,Skipped\n");
+	prefixes.for_each(write_range, fd);
+
+	fclose(fd);
+	return true;
+}
@@ -0,0 +1,71 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PREFIX_TRACKER_H
+#define PREFIX_TRACKER_H
+
+#include <stdint.h>
+
+#include "prefix_map.h"
+
+/* Adaptive scanning of tarpitted /24s. Tarpits such as LaBrea usually
+   answer for every unused address in a block, so once a /24 has produced
+   enough identical tarpit verdicts (same result, window, options and TTL)
+   it is marked as a tarpit range and only every Nth address in it is still
+   probed. A sampled address that disagrees puts the prefix back to full
+   scanning for good. */
+
+struct PrefixState {
+	uint32_t prefix;			/* Address >> 8, host byte order */
+	int8_t result;				/* Result of the tarpit signature */
+	uint16_t window_size;
+	uint8_t options;
+	uint8_t ttl;
+	uint16_t consistent;		/* Matching tarpit verdicts so far */
+	uint8_t state;
+	uint32_t probed;
+	PrefixSample sample;		/* Active while sparse */
+};
+
+class PrefixTracker {
+	public:
+		PrefixTracker(uint16_t threshold, uint16_t sample_rate);
+		~PrefixTracker();
+
+		/* Returns true if addr (network byte order) should not be probed
+		   because its /24 is a known tarpit range */
+		bool should_skip(uint32_t addr);
+
+		/* Feed in the result of a scan of addr (network byte order) */
+		void record(uint32_t addr, int result, uint16_t window_size, uint8_t options, uint8_t ttl);
+
+		/* Write the tarpit ranges found, one per line, as CSV */
+		bool write_report(const char* filename);
+
+		uint32_t tarpit_ranges();
+
+	private:
+		uint16_t threshold;
+		uint16_t sample_rate;
+		PrefixMap<PrefixState> prefixes;
+};
+
+#endif /* PREFIX_TRACKER_H */
@@ -0,0 +1,231 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "degreaser.h"
+#include "priority.h"
+#include "prng.h"
+#include "result_store.h"
+#include "output/binary_format.h"
+
+PrioritySubnetList::PrioritySubnetList() {
+	current_block = 0;
+	block_pos = 0;
+	scheduled = false;
+}
+
+PrioritySubnetList::~PrioritySubnetList() { }
+
+size_t PrioritySubnetList::scored_prefixes() {
+	return scores.size();
+}
+
+bool PrioritySubnetList::load_scores(const char* filename) {
+	char magic[8];
+	bool ok;
+
+	FILE* fd = fopen(filename, "r");
+	if(!fd) {
+		fprintf(stderr, "error: failed to open score file '%s'. Reason: %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	/* Previous results count the tarpits found in each /24 */
+	if(sizeof(magic) == fread(magic, 1, sizeof(magic), fd) && 0 == memcmp(magic, BINARY_FORMAT_MAGIC, sizeof(magic))) {
+		BinaryFileHeader header;
+		rewind(fd);
+		if(1 != fread(&header, sizeof(header), 1, fd)
+				|| (header.record_size != sizeof(ScanRecord) && header.record_size != BINARY_FORMAT_V1_RECORD_SIZE)) {
+			fprintf(stderr, "error: '%s' is not a compatible degreaser binary file\n", filename);
+			fclose(fd);
+			return false;
+		}
+		/* An unfinished file has no record count; read what is there */
+		ok = load_records(fd, header.index_offset ? header.record_count : ~0ULL, header.record_size);
+	} else if(0 == memcmp(magic, RESULT_STORE_MAGIC, sizeof(magic))) {
+		ResultStoreHeader header;
+		rewind(fd);
+		if(1 != fread(&header, sizeof(header), 1, fd) || header.version != RESULT_STORE_VERSION
+				|| header.record_size != sizeof(ScanRecord)) {
+			fprintf(stderr, "error: '%s' is not a compatible degreaser result store\n", filename);
+			fclose(fd);
+			return false;
+		}
+		ok = load_records(fd, header.record_count, header.record_size);
+	} else {
+		rewind(fd);
+		ok = load_text(fd, filename);
+	}
+
+	fclose(fd);
+	return ok;
+}
+
+/* Only the address and result are used, which older, shorter records have too */
+bool PrioritySubnetList::load_records(FILE* fd, uint64_t count, uint16_t record_size) {
+	ScanRecord r;
+
+	while(count-- > 0 && 1 == fread(&r, record_size, 1, fd)) {
+		if(r.result == LABREA || r.result == IPTABLES || r.result == TARPIT || r.result == DELUDE) {
+			scores[ntohl(r.addr) >> 8] += 1;
+		}
+	}
+	return true;
+}
+
+/* Lines of "a.b.c.d/len score". Prefixes shorter than /24 score every /24
+   they cover; longer ones score the /24 they are in. */
+bool PrioritySubnetList::load_text(FILE* fd, const char* filename) {
+	char* line = NULL;
+	size_t size;
+	int lineno = 0;
+	bool ok = true;
+
+	while(-1 != getline(&line, &size, fd)) {
+		char prefix[32];
+		unsigned int len;
+		double score;
+		struct in_addr ia;
+
+		lineno++;
+		if(line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+			continue;
+		}
+
+		if(3 != sscanf(line, "%31[0-9.]/%u %lf", prefix, &len, &score) || len > 32 || !inet_aton(prefix, &ia)) {
+			fprintf(stderr, "error: %s:%d: invalid score line\n", filename, lineno);
+			ok = false;
+			break;
+		}
+		if(score <= 0) {
+			continue;
+		}
+
+		uint32_t first = ntohl(ia.s_addr) >> 8;
+		uint32_t n = len >= 24 ? 1 : 1u << (24 - len);
+		first &= ~(n - 1);
+		for(uint32_t i = 0; i < n; i++) {
+			double& s = scores[first + i];
+			if(score > s) {
+				s = score;
+			}
+		}
+	}
+
+	free(line);
+	return ok;
+}
+
+bool PrioritySubnetList::block_before(const Block& a, const Block& b) {
+	return a.score != b.score ? a.score > b.score : a.first < b.first;
+}
+
+/* Cut the scored /24s out of the targets and order them by score */
+void PrioritySubnetList::schedule() {
+	for(list<Subnet>::iterator iter = subnets.begin(); iter != subnets.end(); iter++) {
+		uint32_t first = iter->first();
+		uint32_t last = iter->last();
+
+		map<uint32_t, double>::iterator s = scores.lower_bound(first >> 8);
+		for(; s != scores.end() && s->first <= (last >> 8); s++) {
+			uint32_t block_first = max(first, s->first << 8);
+			uint32_t block_last = min(last, (s->first << 8) | 0xff);
+			Block b;
+			b.first = block_first;
+			b.count = block_last - block_first + 1;
+			b.score = s->second;
+			blocks.push_back(b);
+		}
+	}
+
+	sort(blocks.begin(), blocks.end(), block_before);
+	current_block = 0;
+	block_pos = 0;
+	if(!blocks.empty()) {
+		shuffle_block();
+	}
+	scheduled = true;
+}
+
+/* Random order within the current block */
+void PrioritySubnetList::shuffle_block() {
+	uint16_t count = blocks[current_block].count;
+
+	for(uint16_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	for(uint16_t i = count - 1; i > 0; i--) {
+		uint16_t j = prng_range(0, i + 1);
+		uint8_t t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+bool PrioritySubnetList::in_scored_block(uint32_t haddr) {
+	return scores.find(haddr >> 8) != scores.end();
+}
+
+uint32_t PrioritySubnetList::next_address() {
+	uint32_t next = 0;
+
+	pthread_mutex_lock(&lock);
+
+	if(!scheduled) {
+		schedule();
+	}
+
+	/* Scored blocks first */
+	while(current_block < blocks.size()) {
+		Block& b = blocks[current_block];
+		if(block_pos < b.count) {
+			next = htonl(b.first + order[block_pos++]);
+			break;
+		}
+		block_pos = 0;
+		if(++current_block < blocks.size()) {
+			shuffle_block();
+		}
+	}
+
+	/* Then the rest in input order, leaving out what was already scanned */
+	while(next == 0 && subnets.size() > 0) {
+		next = subnets.begin()->next();
+		if(next == 0) {
+			subnets.pop_front();
+		} else if(in_scored_block(ntohl(next))) {
+			next = 0;
+		}
+	}
+
+	addr_offset++;
+
+	pthread_mutex_unlock(&lock);
+
+	return next;
+}
@@ -0,0 +1,74 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <map>
+#include <vector>
+
+#include "subnet_list.h"
+
+using namespace std;
+
+/* Scans the /24s most likely to hold tarpits first. Scores per /24 come
+   from a previous run's binary output or result store (the number of
+   tarpits found in each /24), or from a text file of "prefix score" lines.
+   Scored /24s are scanned in order of decreasing score, each in a random
+   order of its own, then everything else follows in input order. */
+class PrioritySubnetList : public SubnetList {
+	public:
+		PrioritySubnetList();
+		~PrioritySubnetList();
+
+		/* Load scores from a binary output file, result store or score file */
+		bool load_scores(const char* filename);
+
+		uint32_t next_address();
+
+		size_t scored_prefixes();
+
+	private:
+		struct Block {
+			uint32_t first;		/* Host byte order */
+			uint16_t count;
+			double score;
+		};
+
+		static bool block_before(const Block& a, const Block& b);
+
+		void schedule();
+		bool load_records(FILE* fd, uint64_t count, uint16_t record_size);
+		bool load_text(FILE* fd, const char* filename);
+		bool in_scored_block(uint32_t haddr);
+		void shuffle_block();
+
+		map<uint32_t, double> scores;	/* /24 (address >> 8) to score */
+		vector<Block> blocks;
+		size_t current_block;
+		uint16_t block_pos;
+		uint8_t order[256];
+		bool scheduled;
+};
+
+#endif /* PRIORITY_H */
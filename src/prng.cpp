@@ -0,0 +1,169 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#ifdef HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#include "prng.h"
+
+#define PRNG_BUFFER_SIZE	256
+
+struct PrngState {
+	uint64_t s[4];
+	uint8_t buffer[PRNG_BUFFER_SIZE];
+	uint16_t buffer_pos;
+	bool seeded;
+};
+
+static __thread PrngState prng_state;
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Fall back to /dev/urandom, and as a last resort mix the clock, pid and
+   thread id so that threads at least never share a stream. */
+static void prng_seed_fallback(void* buf, size_t len) {
+	FILE* fd = fopen("/dev/urandom", "r");
+	if(fd) {
+		size_t n = fread(buf, 1, len, fd);
+		fclose(fd);
+		if(n == len) {
+			return;
+		}
+	}
+
+	fprintf(stderr, "warning: No kernel random source available. Random values will be predictable!\n");
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t x = ((uint64_t)ts.tv_sec << 32) ^ ts.tv_nsec ^ ((uint64_t)getpid() << 16) ^ (uint64_t)pthread_self();
+	uint8_t* p = (uint8_t*)buf;
+	for(size_t i = 0; i < len; i++) {
+		/* splitmix64 step per 8 bytes */
+		if(i % 8 == 0) {
+			x += 0x9e3779b97f4a7c15ULL;
+		}
+		uint64_t z = x;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		p[i] = z >> ((i % 8) * 8);
+	}
+}
+
+void prng_seed_bytes(void* buf, size_t len) {
+#ifdef HAVE_GETRANDOM
+	uint8_t* p = (uint8_t*)buf;
+	while(len > 0) {
+		ssize_t n = getrandom(p, len, 0);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			prng_seed_fallback(p, len);
+			return;
+		}
+		p += n;
+		len -= n;
+	}
+#else
+	prng_seed_fallback(buf, len);
+#endif
+}
+
+static inline PrngState* prng_get() {
+	PrngState* st = &prng_state;
+	if(__builtin_expect(!st->seeded, 0)) {
+		/* xoshiro must not start from an all zero state */
+		do {
+			prng_seed_bytes(st->s, sizeof(st->s));
+		} while((st->s[0] | st->s[1] | st->s[2] | st->s[3]) == 0);
+		st->buffer_pos = PRNG_BUFFER_SIZE;
+		st->seeded = true;
+	}
+	return st;
+}
+
+/* xoshiro256** by Blackman and Vigna */
+static inline uint64_t xoshiro_next(PrngState* st) {
+	uint64_t* s = st->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+uint64_t prng_next64() {
+	return xoshiro_next(prng_get());
+}
+
+uint32_t prng_next32() {
+	/* The high bits are the strongest */
+	return xoshiro_next(prng_get()) >> 32;
+}
+
+uint32_t prng_range(uint32_t min, uint32_t max) {
+	if(max <= min) {
+		return min;
+	}
+	/* Multiply-shift reduction. The bias is at most range / 2^32, which is
+	   far below anything a scan can observe. */
+	uint64_t range = max - min;
+	return min + ((prng_next32() * range) >> 32);
+}
+
+void prng_fill(void* buf, size_t len) {
+	PrngState* st = prng_get();
+	uint8_t* out = (uint8_t*)buf;
+
+	while(len > 0) {
+		if(st->buffer_pos == PRNG_BUFFER_SIZE) {
+			for(size_t i = 0; i < PRNG_BUFFER_SIZE; i += 8) {
+				uint64_t v = xoshiro_next(st);
+				memcpy(st->buffer + i, &v, 8);
+			}
+			st->buffer_pos = 0;
+		}
+		size_t n = PRNG_BUFFER_SIZE - st->buffer_pos;
+		if(n > len) {
+			n = len;
+		}
+		memcpy(out, st->buffer + st->buffer_pos, n);
+		st->buffer_pos += n;
+		out += n;
+		len -= n;
+	}
+}
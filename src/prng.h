@@ -0,0 +1,46 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Fast per-thread pseudo random numbers for sequence numbers, source ports
+   and probe payloads. Each thread gets its own xoshiro256** stream, seeded
+   from the kernel the first time that thread asks for a number, so there is
+   no shared state and no locking. Not suitable for anything cryptographic. */
+
+uint32_t prng_next32();
+uint64_t prng_next64();
+
+/* Uniform value in [min, max). Returns min if the range is empty. */
+uint32_t prng_range(uint32_t min, uint32_t max);
+
+/* Fill buf with random bytes, served from a per-thread refillable buffer */
+void prng_fill(void* buf, size_t len);
+
+/* Fill buf with bytes straight from the kernel's random source. Slower than
+   prng_fill(), meant for keys and seeds. */
+void prng_seed_bytes(void* buf, size_t len);
+
+#endif /* PRNG_H */
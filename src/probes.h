@@ -0,0 +1,53 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/* USDT static tracepoints for attaching bpftrace, perf or SystemTap to a
+   running degreaser. Each probe compiles to a single nop plus an ELF note,
+   so they cost nothing when nothing is attached. Without <sys/sdt.h> the
+   probes compile away entirely.
+
+   Probes (provider "degreaser"):
+	probe_send(addr, src_port, dst_port)			before a probe is sent
+	reply_recv(addr, src_port, rtt_us)				a reply arrived
+	reply_timeout(addr, src_port)					no reply within the timeout
+	classify(addr, result, window_size, options)	final result of a scan
+	exclude_check(addr, excluded)					exclude list lookup
+	output_dispatch(addr, result)					result handed to an output
+
+   Addresses are IPv4 in network byte order. Example:
+	bpftrace -e 'usdt:./degreaser:degreaser:classify { @[arg1] = count(); }' */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define DEGREASER_PROBE2(name, a, b)			DTRACE_PROBE2(degreaser, name, a, b)
+#define DEGREASER_PROBE3(name, a, b, c)			DTRACE_PROBE3(degreaser, name, a, b, c)
+#define DEGREASER_PROBE4(name, a, b, c, d)		DTRACE_PROBE4(degreaser, name, a, b, c, d)
+#else
+#define DEGREASER_PROBE2(name, a, b)			do { } while(0)
+#define DEGREASER_PROBE3(name, a, b, c)			do { } while(0)
+#define DEGREASER_PROBE4(name, a, b, c, d)		do { } while(0)
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* PROBES_H */
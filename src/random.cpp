@@ -28,6 +28,7 @@
 
 #include "degreaser.h"
 #include "random.h"
+#include "prng.h"
 
 #define FLIP_BYTES(a) ((((a) & 0xff) << 24) | ((((a) >> 8) & 0xff) << 16) | ((((a) >> 16) & 0xff) << 8) | ((((a) >> 24) & 0xff)))
 
@@ -48,6 +49,8 @@ void RandomSubnetList::seed() {
 	uint8_t buffer[16];
 	PermMode mode = PERM_MODE_CYCLE;
 
+	prng_seed_bytes(buffer, sizeof(buffer));
+
 	/* Switch to libperm's prefix mode if the total number of hosts to scan is less than 50000. This number
 	   is completely arbitrary. The choice is a time/space tradeoff. More testing should be done to select
 	   the right switchover point.
@@ -94,7 +97,7 @@ uint32_t RandomSubnetList::next_address() {
 }
 
 uint32_t RandomSubnetList::rand(uint32_t min, uint32_t max) {
-	return ::rand() % (max - min) + min;
+	return prng_range(min, max);
 }
 
 #endif /* HAVE_LIBCPERM */
@@ -0,0 +1,202 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "reply_parser.h"
+#include "scan_record.h"
+
+#define ETHERTYPE_IPV4	0x0800
+#define ETHERTYPE_VLAN	0x8100
+
+static inline uint16_t get16(const uint8_t* p) {
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t* p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Clear the decoded fields; option_kinds is only valid up to option_count */
+static void reply_reset(const uint8_t* pkt, size_t len, ReplyInfo* r) {
+	memset(r, 0, offsetof(ReplyInfo, option_kinds));
+	memset(&r->mss, 0, sizeof(ReplyInfo) - offsetof(ReplyInfo, mss));
+	r->unknown_option = -1;
+	r->ip = pkt;
+	r->ip_caplen = len > 0xffff ? 0xffff : len;
+}
+
+/* Follow the EtherType at offset, skipping 802.1Q tags, to the IPv4 header */
+static bool parse_ethertype(const uint8_t* frame, size_t len, size_t offset, ReplyInfo* r) {
+	reply_reset(frame, len, r);
+	if(len < offset + 2) {
+		return false;
+	}
+
+	uint16_t type = get16(frame + offset);
+	offset += 2;
+	while(type == ETHERTYPE_VLAN) {
+		if(len < offset + 4) {
+			return false;
+		}
+		type = get16(frame + offset + 2);
+		offset += 4;
+	}
+
+	if(type != ETHERTYPE_IPV4) {
+		return false;
+	}
+
+	return reply_parse_ip(frame + offset, len - offset, r);
+}
+
+bool reply_parse_ethernet(const uint8_t* frame, size_t len, ReplyInfo* r) {
+	return parse_ethertype(frame, len, 12, r);
+}
+
+bool reply_parse_sll(const uint8_t* frame, size_t len, ReplyInfo* r) {
+	return parse_ethertype(frame, len, 14, r);
+}
+
+/* Walks the TCP options. option_count follows libcrafter's layer count,
+   so NOP and EOL entries are counted too. */
+static void parse_tcp_options(const uint8_t* opt, size_t len, ReplyInfo* r) {
+	size_t i = 0;
+
+	while(i < len) {
+		uint8_t kind = opt[i];
+		uint8_t olen;
+
+		if(r->option_count < REPLY_MAX_OPTIONS) {
+			r->option_kinds[r->option_count] = kind;
+		}
+		r->option_count++;
+
+		if(kind == 0) {
+			break;
+		} else if(kind == 1) {
+			i++;
+			continue;
+		}
+
+		if(i + 1 >= len || (olen = opt[i + 1]) < 2 || i + olen > len) {
+			break;
+		}
+
+		switch(kind) {
+			case 2:
+				r->options |= SCAN_OPT_MSS;
+				if(olen == 4) r->mss = get16(opt + i + 2);
+				break;
+			case 3:
+				r->options |= SCAN_OPT_WINSCALE;
+				if(olen == 3) r->wscale = opt[i + 2];
+				break;
+			case 4:
+			case 5:
+				r->options |= SCAN_OPT_SACK;
+				break;
+			case 8:
+				r->options |= SCAN_OPT_TIMESTAMP;
+				if(olen == 10) {
+					r->ts_val = get32(opt + i + 2);
+					r->ts_ecr = get32(opt + i + 6);
+				}
+				break;
+			default:
+				r->unknown_option = kind;
+				break;
+		}
+		i += olen;
+	}
+}
+
+bool reply_parse_ip(const uint8_t* pkt, size_t len, ReplyInfo* r) {
+	reply_reset(pkt, len, r);
+	if(len < 20 || (pkt[0] >> 4) != 4) {
+		return false;
+	}
+
+	size_t hlen = (pkt[0] & 0x0f) * 4;
+	if(hlen < 20 || hlen > len) {
+		return false;
+	}
+
+	r->ip_len = get16(pkt + 2);
+	r->ip_id = get16(pkt + 4);
+	r->ttl = pkt[8];
+	r->protocol = pkt[9];
+	memcpy(&r->src_addr, pkt + 12, 4);
+	memcpy(&r->dst_addr, pkt + 16, 4);
+
+	/* Trust the IP total length over the capture length, which may include
+	   Ethernet padding */
+	size_t end = r->ip_len < len ? r->ip_len : len;
+	if(end < hlen) {
+		return false;
+	}
+
+	const uint8_t* l4 = pkt + hlen;
+	size_t l4_len = end - hlen;
+
+	if(r->protocol == IPPROTO_TCP) {
+		if(l4_len < 20) {
+			return false;
+		}
+		size_t doff = (l4[12] >> 4) * 4;
+		if(doff < 20 || doff > l4_len) {
+			return false;
+		}
+
+		r->src_port = get16(l4);
+		r->dst_port = get16(l4 + 2);
+		r->seq = get32(l4 + 4);
+		r->ack = get32(l4 + 8);
+		r->tcp_flags = l4[13];
+		r->window = get16(l4 + 14);
+		r->payload_len = l4_len - doff;
+		parse_tcp_options(l4 + 20, doff - 20, r);
+		return true;
+	} else if(r->protocol == IPPROTO_ICMP) {
+		if(l4_len < 8) {
+			return false;
+		}
+		r->icmp_type = l4[0];
+		r->icmp_code = l4[1];
+
+		/* Errors quote the offending IP header and at least 8 bytes of it */
+		const uint8_t* inner = l4 + 8;
+		size_t inner_len = l4_len - 8;
+		if(inner_len >= 20 && (inner[0] >> 4) == 4) {
+			size_t inner_hlen = (inner[0] & 0x0f) * 4;
+			memcpy(&r->icmp_orig_dst, inner + 16, 4);
+			if(inner_hlen >= 20 && inner_len >= inner_hlen + 4) {
+				r->icmp_orig_src_port = get16(inner + inner_hlen);
+				r->icmp_orig_dst_port = get16(inner + inner_hlen + 2);
+			}
+		}
+		return true;
+	}
+
+	return true;
+}
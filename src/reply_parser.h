@@ -0,0 +1,79 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef REPLY_PARSER_H
+#define REPLY_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REPLY_MAX_OPTIONS	20
+
+/* Fields of a reply packet, decoded straight from the captured bytes. The
+   parser never allocates and never copies packet data; ip points back into
+   the caller's buffer. */
+struct ReplyInfo {
+	const uint8_t* ip;			/* Start of the IP header */
+	uint16_t ip_caplen;			/* Bytes available from ip onwards */
+
+	/* IPv4 */
+	uint8_t protocol;
+	uint8_t ttl;
+	uint16_t ip_id;
+	uint16_t ip_len;
+	uint32_t src_addr;			/* Network byte order */
+	uint32_t dst_addr;			/* Network byte order */
+
+	/* TCP, valid if protocol == IPPROTO_TCP */
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint32_t seq;
+	uint32_t ack;
+	uint8_t tcp_flags;
+	uint16_t window;
+	uint16_t payload_len;
+	uint8_t option_count;		/* Option entries, including NOP and EOL */
+	uint8_t options;			/* SCAN_OPT_* */
+	uint8_t option_kinds[REPLY_MAX_OPTIONS];	/* Option kinds in the order sent */
+	uint16_t mss;
+	uint8_t wscale;
+	uint32_t ts_val;
+	uint32_t ts_ecr;
+	int unknown_option;			/* Last unrecognized option kind, or -1 */
+
+	/* ICMP, valid if protocol == IPPROTO_ICMP */
+	uint8_t icmp_type;
+	uint8_t icmp_code;
+	uint32_t icmp_orig_dst;		/* Destination of the packet that triggered the error */
+	uint16_t icmp_orig_src_port;
+	uint16_t icmp_orig_dst_port;
+};
+
+/* Parse a frame starting at the Ethernet header (with optional 802.1Q tag) */
+bool reply_parse_ethernet(const uint8_t* frame, size_t len, ReplyInfo* r);
+
+/* Parse a frame starting at a Linux cooked capture (SLL) header */
+bool reply_parse_sll(const uint8_t* frame, size_t len, ReplyInfo* r);
+
+/* Parse a packet starting at the IPv4 header */
+bool reply_parse_ip(const uint8_t* pkt, size_t len, ReplyInfo* r);
+
+#endif /* REPLY_PARSER_H */
@@ -0,0 +1,249 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "result_store.h"
+
+#define STORE_BYTE_ORDER	0x01020304
+#define PREFIX_WORDS		((1 << 24) / 64)
+
+static bool record_less(const ScanRecord& a, const ScanRecord& b) {
+	return ntohl(a.addr) < ntohl(b.addr);
+}
+
+ResultStore::ResultStore(string fn) : filename(fn) {
+	changed = (uint64_t*)calloc(PREFIX_WORDS, sizeof(uint64_t));
+	last_changed = (uint64_t*)calloc(PREFIX_WORDS, sizeof(uint64_t));
+	incremental = false;
+	stale_secs = 0;
+	now = time(NULL);
+}
+
+ResultStore::~ResultStore() {
+	free(changed);
+	free(last_changed);
+}
+
+size_t ResultStore::size() const {
+	return records.size();
+}
+
+void ResultStore::set_incremental(uint32_t s) {
+	incremental = true;
+	stale_secs = s;
+}
+
+bool ResultStore::load() {
+	ResultStoreHeader header;
+	struct stat st;
+	vector<uint32_t> prefixes;
+	FILE* fd = fopen(filename.c_str(), "r");
+
+	if(!fd) {
+		if(errno == ENOENT) {
+			return true;
+		}
+		fprintf(stderr, "error: failed to open result store '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	if(1 != fread(&header, sizeof(header), 1, fd) || 0 != memcmp(header.magic, RESULT_STORE_MAGIC, sizeof(RESULT_STORE_MAGIC))
+			|| header.byte_order != STORE_BYTE_ORDER || header.version != RESULT_STORE_VERSION
+			|| header.record_size != sizeof(ScanRecord)) {
+		fprintf(stderr, "error: '%s' is not a compatible degreaser result store\n", filename.c_str());
+		fclose(fd);
+		return false;
+	}
+
+	/* Don't trust the counts with more than the file can hold */
+	if(0 != fstat(fileno(fd), &st) || header.record_count > (st.st_size - sizeof(header)) / sizeof(ScanRecord)
+			|| header.changed_count > (st.st_size - sizeof(header) - header.record_count * sizeof(ScanRecord)) / sizeof(uint32_t)) {
+		fprintf(stderr, "error: result store '%s' is truncated\n", filename.c_str());
+		fclose(fd);
+		return false;
+	}
+
+	records.resize(header.record_count);
+	if(header.record_count > 0 && header.record_count != fread(&records[0], sizeof(ScanRecord), header.record_count, fd)) {
+		fprintf(stderr, "error: result store '%s' is truncated\n", filename.c_str());
+		fclose(fd);
+		return false;
+	}
+	prefixes.resize(header.changed_count);
+	if(header.changed_count > 0 && header.changed_count != fread(&prefixes[0], sizeof(uint32_t), header.changed_count, fd)) {
+		fprintf(stderr, "error: result store '%s' is truncated\n", filename.c_str());
+		fclose(fd);
+		return false;
+	}
+	fclose(fd);
+
+	for(size_t i = 0; i < prefixes.size(); i++) {
+		uint32_t prefix = prefixes[i] & 0xffffff;
+		last_changed[prefix / 64] |= 1ULL << (prefix % 64);
+	}
+
+	/* find() relies on the order. A store written by hand or by something
+	   else may not keep it. */
+	for(size_t i = 1; i < records.size(); i++) {
+		if(record_less(records[i], records[i - 1])) {
+			fprintf(stderr, "warning: result store '%s' is not sorted, sorting it\n", filename.c_str());
+			sort(records.begin(), records.end(), record_less);
+			break;
+		}
+	}
+
+	return true;
+}
+
+const ScanRecord* ResultStore::find(uint32_t addr) const {
+	ScanRecord key;
+	key.addr = addr;
+
+	vector<ScanRecord>::const_iterator iter = lower_bound(records.begin(), records.end(), key, record_less);
+	if(iter == records.end() || iter->addr != addr) {
+		return NULL;
+	}
+	return &*iter;
+}
+
+bool ResultStore::prefix_changed(uint32_t haddr) const {
+	uint32_t prefix = haddr >> 8;
+	uint64_t bit = 1ULL << (prefix % 64);
+	return (last_changed[prefix / 64] & bit) || (__atomic_load_n(&changed[prefix / 64], __ATOMIC_RELAXED) & bit);
+}
+
+bool ResultStore::needs_scan(uint32_t addr) const {
+	if(!incremental) {
+		return true;
+	}
+
+	const ScanRecord* r = find(addr);
+	if(!r) {
+		return true;
+	}
+
+	/* Anything that ever answered is worth checking again */
+	if(r->result != NO_RESPONSE) {
+		return true;
+	}
+
+	if(now - r->timestamp > stale_secs) {
+		return true;
+	}
+
+	return prefix_changed(ntohl(addr));
+}
+
+void ResultStore::update(const ScanRecord& r) {
+	/* Results that say nothing about the host must not replace real ones */
+	if(r.result == DRY_RUN || r.result == NOT_SCANNED) {
+		return;
+	}
+
+	/* A host that now answers differently suggests the rest of its /24 may
+	   have changed too, so silent neighbours are rescanned as well */
+	const ScanRecord* old = find(r.addr);
+	if(old ? old->result != r.result : r.result != NO_RESPONSE) {
+		uint32_t prefix = ntohl(r.addr) >> 8;
+		__atomic_or_fetch(&changed[prefix / 64], 1ULL << (prefix % 64), __ATOMIC_RELAXED);
+	}
+
+	updates.push_back(r);
+}
+
+bool ResultStore::save() {
+	vector<ScanRecord> merged;
+	vector<uint32_t> prefixes;
+	ResultStoreHeader header;
+	string tmp = filename + ".tmp";
+
+	/* Later results for the same address win */
+	stable_sort(updates.begin(), updates.end(), record_less);
+	merged.reserve(records.size() + updates.size());
+
+	vector<ScanRecord>::const_iterator a = records.begin(), b = updates.begin();
+	while(a != records.end() || b != updates.end()) {
+		if(b == updates.end() || (a != records.end() && record_less(*a, *b))) {
+			merged.push_back(*a++);
+		} else {
+			if(a != records.end() && a->addr == b->addr) {
+				a++;
+			}
+			while(b + 1 != updates.end() && (b + 1)->addr == b->addr) {
+				b++;
+			}
+			merged.push_back(*b++);
+		}
+	}
+
+	/* The next run rescans the silent neighbours of this run's changes */
+	for(uint32_t i = 0; i < PREFIX_WORDS; i++) {
+		for(uint64_t w = changed[i]; w != 0; w &= w - 1) {
+			prefixes.push_back(i * 64 + __builtin_ctzll(w));
+		}
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RESULT_STORE_MAGIC, sizeof(RESULT_STORE_MAGIC));
+	header.byte_order = STORE_BYTE_ORDER;
+	header.version = RESULT_STORE_VERSION;
+	header.record_size = sizeof(ScanRecord);
+	header.record_count = merged.size();
+	header.updated_time = time(NULL);
+	header.changed_count = prefixes.size();
+
+	FILE* fd = fopen(tmp.c_str(), "w");
+	if(!fd) {
+		fprintf(stderr, "error: failed to write result store '%s'. Reason: %s\n", tmp.c_str(), strerror(errno));
+		return false;
+	}
+	bool ok = 1 == fwrite(&header, sizeof(header), 1, fd);
+	if(ok && !merged.empty()) {
+		ok = merged.size() == fwrite(&merged[0], sizeof(ScanRecord), merged.size(), fd);
+	}
+	if(ok && !prefixes.empty()) {
+		ok = prefixes.size() == fwrite(&prefixes[0], sizeof(uint32_t), prefixes.size(), fd);
+	}
+	if(0 != fclose(fd) || !ok) {
+		fprintf(stderr, "error: failed to write result store '%s'. Reason: %s\n", tmp.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	if(0 != rename(tmp.c_str(), filename.c_str())) {
+		fprintf(stderr, "error: failed to replace result store '%s'. Reason: %s\n", filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	records.swap(merged);
+	updates.clear();
+	return true;
+}
@@ -0,0 +1,103 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "scan_record.h"
+
+using namespace std;
+
+/* Layout of a result store file:
+
+	ResultStoreHeader
+	ScanRecord[record_count]	one per address, sorted by address
+	uint32_t[changed_count]		/24s whose results changed in the last run
+
+   The store holds the latest result for every address ever scanned, and is
+   rewritten (to a temporary file, then renamed) at the end of each run with
+   the new results merged in. */
+
+#define RESULT_STORE_MAGIC		"DGRSTOR"
+#define RESULT_STORE_VERSION	3
+
+struct ResultStoreHeader {
+	char magic[8];
+	uint32_t byte_order;
+	uint16_t version;
+	uint16_t record_size;
+	uint64_t record_count;
+	uint64_t updated_time;
+	uint64_t changed_count;
+};
+
+/* Previous results for incremental rescans. The loaded records are never
+   modified during a run, so scanner threads can look addresses up without
+   locking. New results are collected by a single thread (the output writer)
+   and merged in by save(). */
+class ResultStore {
+	public:
+		ResultStore(string filename);
+		~ResultStore();
+
+		/* Load the store. A missing file is an empty store. */
+		bool load();
+
+		/* Skip addresses that were unresponsive less than stale_secs ago,
+		   unless something in their /24 changed in the last run. Everything
+		   else is rescanned. Changes seen during this run also bring back
+		   the addresses of the /24 that are drawn after them; the ones
+		   already skipped are probed on the next run, which loads the
+		   changed /24s from the store before it starts. */
+		void set_incremental(uint32_t stale_secs);
+
+		/* Whether addr (network byte order) has to be probed this run */
+		bool needs_scan(uint32_t addr) const;
+
+		/* Latest stored result for addr (network byte order), or NULL */
+		const ScanRecord* find(uint32_t addr) const;
+
+		/* Add a new result. Not thread safe; called from the output writer. */
+		void update(const ScanRecord& r);
+
+		/* Merge the new results in and write the store back out */
+		bool save();
+
+		size_t size() const;
+
+	private:
+		bool prefix_changed(uint32_t haddr) const;
+
+		string filename;
+		vector<ScanRecord> records;
+		vector<ScanRecord> updates;
+		uint64_t* changed;			/* Bitmap of /24s whose results changed this run */
+		uint64_t* last_changed;		/* The same for the last run, from the store */
+		bool incremental;
+		uint32_t stale_secs;
+		uint32_t now;
+};
+
+#endif /* RESULT_STORE_H */
@@ -0,0 +1,208 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <list>
+
+#include "retry_pass.h"
+
+static uint64_t retry_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Positions follow the order of the subnets in the list, the same index
+   space the random scan permutes */
+RetryPass::RetryPass(SubnetList* target_list, uint8_t p, uint32_t delay_secs) : passes(p), delay(delay_secs) {
+	std::list<Subnet> subnets = target_list->get_subnets();
+	Range r;
+
+	targets = 0;
+	for(std::list<Subnet>::iterator iter = subnets.begin(); iter != subnets.end(); iter++) {
+		r.first = iter->first();
+		r.count = iter->count();
+		r.position = targets;
+		by_position.push_back(r);
+		targets += r.count;
+	}
+	by_first = by_position;
+	sort(by_first.begin(), by_first.end(), first_before);
+
+	words = (targets + 63) / 64;
+	pending = new uint64_t[words];
+	marked = new uint64_t[words];
+	memset(pending, 0, words * sizeof(uint64_t));
+	memset(marked, 0, words * sizeof(uint64_t));
+	marked_count = 0;
+	outstanding = 0;
+	cursor = words;
+	current = 0;
+	idle_since = 0;
+	list_finished = false;
+	done = false;
+	pthread_mutex_init(&lock, NULL);
+}
+
+RetryPass::~RetryPass() {
+	pthread_mutex_destroy(&lock);
+	delete[] pending;
+	delete[] marked;
+}
+
+bool RetryPass::first_before(const Range& a, const Range& b) {
+	return a.first < b.first;
+}
+
+bool RetryPass::position_of(uint32_t haddr, uint32_t* pos) const {
+	Range key;
+
+	key.first = haddr;
+	vector<Range>::const_iterator iter = upper_bound(by_first.begin(), by_first.end(), key, first_before);
+	if(iter == by_first.begin()) {
+		return false;
+	}
+	--iter;
+	if(haddr - iter->first >= iter->count) {
+		return false;
+	}
+	*pos = iter->position + (haddr - iter->first);
+	return true;
+}
+
+uint32_t RetryPass::address_at(uint32_t pos) const {
+	size_t lo = 0, hi = by_position.size();
+
+	while(hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if(by_position[mid].position <= pos) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return by_position[lo].first + (pos - by_position[lo].position);
+}
+
+RetryState RetryPass::next(uint32_t* addr) {
+	pthread_mutex_lock(&lock);
+
+	for(;;) {
+		while(cursor < words) {
+			uint64_t w = pending[cursor];
+			if(w != 0) {
+				uint32_t pos = cursor * 64 + __builtin_ctzll(w);
+				pending[cursor] = w & (w - 1);
+				__atomic_add_fetch(&outstanding, 1, __ATOMIC_RELAXED);
+				pthread_mutex_unlock(&lock);
+				*addr = htonl(address_at(pos));
+				return RETRY_TARGET;
+			}
+			cursor++;
+		}
+
+		if(!next_pass()) {
+			break;
+		}
+	}
+
+	RetryState state = done ? RETRY_DONE : RETRY_WAIT;
+	pthread_mutex_unlock(&lock);
+	return state;
+}
+
+/* Start the next pass once every scan of this one has finished and the pass
+   delay has gone by. Called with the lock held. Targets from the list are
+   counted as outstanding before they are taken, so the passes can not end
+   with one of them still to be scanned. */
+bool RetryPass::next_pass() {
+	if(done) {
+		return false;
+	}
+	if(__atomic_load_n(&outstanding, __ATOMIC_ACQUIRE) != 0) {
+		return false;
+	}
+	if(current == passes || __atomic_load_n(&marked_count, __ATOMIC_RELAXED) == 0) {
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+		return false;
+	}
+
+	/* Leave the silent hosts alone for a while before asking again */
+	uint64_t now = retry_now();
+	if(idle_since == 0) {
+		idle_since = now;
+	}
+	if(now - idle_since < (uint64_t)delay * 1000000) {
+		return false;
+	}
+
+	uint64_t* t = pending;
+	pending = marked;
+	marked = t;
+	memset(marked, 0, words * sizeof(uint64_t));
+	marked_count = 0;
+	cursor = 0;
+	idle_since = 0;
+	current++;
+	return true;
+}
+
+void RetryPass::started() {
+	__atomic_add_fetch(&outstanding, 1, __ATOMIC_RELAXED);
+}
+
+void RetryPass::unstarted() {
+	__atomic_sub_fetch(&outstanding, 1, __ATOMIC_RELEASE);
+}
+
+void RetryPass::list_done() {
+	__atomic_store_n(&list_finished, true, __ATOMIC_RELEASE);
+}
+
+bool RetryPass::retrying() const {
+	return __atomic_load_n(&list_finished, __ATOMIC_ACQUIRE);
+}
+
+bool RetryPass::finished(uint32_t addr, bool no_response) {
+	uint32_t pos;
+	bool deferred = false;
+
+	/* The pass can not change while this target is outstanding. Once the
+	   passes are over nothing would probe a marked host again, so it is
+	   reported as it is. */
+	if(no_response && current < passes && !__atomic_load_n(&done, __ATOMIC_ACQUIRE) && position_of(ntohl(addr), &pos)) {
+		__atomic_or_fetch(&marked[pos / 64], 1ULL << (pos % 64), __ATOMIC_RELAXED);
+		__atomic_add_fetch(&marked_count, 1, __ATOMIC_RELAXED);
+		deferred = true;
+	}
+	__atomic_sub_fetch(&outstanding, 1, __ATOMIC_RELEASE);
+	return deferred;
+}
+
+uint8_t RetryPass::pass() const {
+	return current;
+}
@@ -0,0 +1,104 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef RETRY_PASS_H
+#define RETRY_PASS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include "subnet_list.h"
+
+using namespace std;
+
+/* Re-probes non-responders in separate passes at the end of the scan,
+   instead of retransmitting each SYN right after its timeout. Every target
+   has a position in the target list as it was when the scan started, and
+   non-responders are marked in a bitmap indexed by that position: one bit
+   per target however many go unanswered. Once the targets of a pass are all
+   finished and the pass delay has gone by, the next pass probes the marked
+   positions again. A host that stays silent is only reported as such after
+   the last pass. */
+enum RetryState {	RETRY_TARGET,
+					RETRY_WAIT,
+					RETRY_DONE };
+
+class RetryPass {
+	public:
+		RetryPass(SubnetList* target_list, uint8_t passes, uint32_t delay_secs);
+		~RetryPass();
+
+		/* Call before taking a target from the target list, so the pass
+		   can not end while the target is on its way to being scanned, and
+		   call unstarted() if the list turned out to be empty. */
+		void started();
+		void unstarted();
+
+		/* Call once the target list has run out. From then on targets only
+		   come from next(). */
+		void list_done();
+		bool retrying() const;
+
+		/* Next address to re-probe (network byte order) in *addr. RETRY_WAIT
+		   means the current pass still has scans outstanding or the pass
+		   delay has not passed yet; ask again later. */
+		RetryState next(uint32_t* addr);
+
+		/* Call with the result of every target, from the list or next().
+		   Returns true if a silent host was marked for another pass, in
+		   which case its result should not be reported yet. */
+		bool finished(uint32_t addr, bool no_response);
+
+		uint8_t pass() const;
+
+	private:
+		struct Range {
+			uint32_t first;			/* Host byte order */
+			uint32_t count;
+			uint32_t position;		/* Position of first in the target list */
+		};
+
+		static bool first_before(const Range& a, const Range& b);
+		bool position_of(uint32_t haddr, uint32_t* pos) const;
+		uint32_t address_at(uint32_t pos) const;
+		bool next_pass();
+
+		vector<Range> by_position;	/* Target list order */
+		vector<Range> by_first;		/* Sorted by address */
+		uint32_t targets;
+		uint32_t words;
+		uint64_t* pending;			/* Positions to probe in this pass */
+		uint64_t* marked;			/* Positions to probe in the next pass */
+		uint32_t marked_count;
+		uint32_t outstanding;
+		uint32_t cursor;			/* Next word of pending to look at */
+		uint8_t current;			/* 0 is the main scan */
+		uint8_t passes;
+		uint32_t delay;
+		uint64_t idle_since;		/* When the last pass finished, 0 if not yet */
+		bool list_finished;
+		bool done;
+		pthread_mutex_t lock;
+};
+
+#endif /* RETRY_PASS_H */
@@ -21,449 +21,606 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <crafter.h>
 
 #include <string>
 
 #include "degreaser.h"
 #include "scan.h"
+#include "trace.h"
+#include "probes.h"
+#include "pcap_writer.h"
+#include "reply_parser.h"
+#include "prng.h"
+#include "signature.h"
+#include "packet_builder.h"
 
 using namespace Crafter;
 
+/* Entries in the selective capture buffer are kept 8 byte aligned */
+#define CAPTURE_ENTRY_SIZE(caplen) ((sizeof(CapturedPacket) + (caplen) + 7) & ~7)
+
 Scan::Scan(DegreaserConfig& c, uint32_t a, uint32_t o) : config(c) {
+	syn_packet = ack_packet = data_packet = rst_packet = NULL;
+	syn_packet_options = 0;
+	capture_buf = NULL;
+	reset(a, o);
+};
+
+Scan::~Scan() {
+	delete syn_packet;
+	delete ack_packet;
+	delete data_packet;
+	delete rst_packet;
+	delete[] capture_buf;
+}
+
+void Scan::reset(uint32_t a, uint32_t o) {
 	ia.s_addr = a;
-	addr = inet_ntoa(ia);
 	send_options = o;
 	result = NOT_SCANNED;
 	window_size = 0;
 	response_flags = 0;
 	response_time = 0;
-
+	confidence = 0;
+	response_ttl = 0;
+	icmp_code = 0;
+	icmp_router = 0;
+	scan_time = 0;
+	capture_used = 0;
+	src_port = dst_port = 0;
 	options = 0;
-	timestamp.SetValue(0xabcfef);
-	win_scale.SetKind(3);
-	win_scale.SetPayload("\x7");
-	win_scale.SetLength(3);
-	mss.SetMaxSegSize(1234);
-	sack.SetKind(4);
-	sack.SetLength(2);
-};
-
-Scan::~Scan() { }
+}
 
 ScanResult Scan::get_result() const {
 	return result;
 }
 
 bool Scan::scan(string dev, uint16_t dport, uint16_t sport, uint16_t timeout, uint16_t retries) {
-	Packet *syn, *syn_resp, *ack, *ack_resp, *data, *data_resp, *rst, *fin, *fin_resp;
-	TCP *syn_resp_tcp, *ack_resp_tcp;
+	Packet *syn, *ack, *data, *rst;	/* Owned by the Scan and reused */
+	ReplyInfo reply;
+	bool replied;
 
-	syn = syn_resp = ack = ack_resp = data = data_resp = fin = fin_resp = NULL;
-	src_port = sport;
-	dst_port = dport;
-	src_seq = rand();
+	/* With retry passes the SYN goes out once; silent hosts get their
+	   retransmissions at the end of the scan instead */
+	uint16_t syn_retries = config.retry ? 1 : retries;
+
+	begin(dport, sport);
 
 	/* Create the SYN packet to scan the host */
-	syn = create_syn(dev, timeout, retries);
-	src_seq++;
-	if(!syn) {
-		LOG_ERROR("Failed to create SYN packet. Aborting.\n");
-		exit(EXIT_FAILURE);
-	}
+	TRACE_BEGIN(TRACE_BUILD_PACKET);
+	syn = create_syn(dev);
+	TRACE_END(TRACE_BUILD_PACKET);
 
 	/* Send the SYN and wait for a response */
-	syn_resp = send_with_response(dev, syn, timeout, retries, &response_time);
-	if(!syn_resp) {
-		if(dry_run) {
+	replied = send_with_response(dev, syn, timeout, syn_retries, &response_time, &reply);
+	if(on_syn_reply(replied ? &reply : NULL)) {
+		goto cleanup;
+	}
+
+	/* In non-fast scan mode, finish the 3-way handshake by sending the final ACK */
+	TRACE_BEGIN(TRACE_BUILD_PACKET);
+	ack = create_ack(dev);
+	TRACE_END(TRACE_BUILD_PACKET);
+	replied = send_with_response(dev, ack, timeout, retries, NULL, &reply);
+	if(on_ack_reply(replied ? &reply : NULL)) {
+		goto cleanup;
+	}
+
+	/* Now try sending a data packet with size one less than the window */
+	TRACE_BEGIN(TRACE_BUILD_PACKET);
+	data = create_data_packet(dev, window_size - 1);
+	TRACE_END(TRACE_BUILD_PACKET);
+	replied = send_with_response(dev, data, timeout, retries, NULL, &reply);
+	on_data_reply(replied ? &reply : NULL);
+
+cleanup:
+	TRACE_BEGIN(TRACE_BUILD_PACKET);
+	rst = create_reset_packet(dev);
+	TRACE_END(TRACE_BUILD_PACKET);
+	if(!config.dry_run) {
+		TRACE_BEGIN(TRACE_SEND);
+		rst->Send(dev);
+		TRACE_END(TRACE_SEND);
+		STATS_INC(packets_sent);
+		dump_packet(rst);
+	}
+
+	finish();
+
+	if(result != NO_RESPONSE) {
+		return true;
+	}
+	return false;
+}
+
+/* The steps below hold the classification logic. scan() drives them with
+   blocking send/receive calls, and the event engine drives them from its
+   own reply and timeout handling, so both classify hosts identically. */
+
+void Scan::begin(uint16_t dport, uint16_t sport) {
+	src_port = sport;
+	dst_port = dport;
+	syn_seq = prng_next32();
+	syn_ip_id = prng_next32();
+	src_seq = syn_seq + 1;
+	dst_seq = 0;
+	scan_time = time(NULL);
+	capture_used = 0;
+	confidence = 100;
+}
+
+bool Scan::on_syn_reply(const ReplyInfo* reply) {
+	if(!reply) {
+		if(config.dry_run) {
 			result = DRY_RUN; 
-			LOG_DEBUG("Scanning %s: Not performed (dry run).\n", addr.c_str());
+			LOG_DEBUG("Scanning %s: Not performed (dry run).\n", address_to_string());
 		} else {
 			result = NO_RESPONSE;
-			LOG_DEBUG("Scanning %s: No response.\n", addr.c_str());
+			LOG_DEBUG("Scanning %s: No response.\n", address_to_string());
 		}
-		goto cleanup;
+		return true;
 	}
 
-	syn_resp_tcp = syn_resp->GetLayer<TCP>();
-	if(!syn_resp_tcp) {
-		ICMP* icmp = syn_resp->GetLayer<ICMP>();
-		if(icmp && icmp->GetType() == 3) {
+	if(reply->protocol != IPPROTO_TCP) {
+		if(reply->protocol == IPPROTO_ICMP && reply->icmp_type == 3) {
 			result = UNREACHABLE;
+			icmp_router = reply->src_addr;
+			icmp_code = reply->icmp_code;
 		} else {
 			result = TCP_ERROR;
 			LOG_WARNING("Response did not contain a TCP header.\n");
 		}
-		goto cleanup;
+		return true;
 	}
-	response_flags = syn_resp_tcp->GetFlags();
-	window_size = syn_resp_tcp->GetWindowsSize();
-	dst_seq = syn_resp_tcp->GetSeqNumber();
+	response_flags = reply->tcp_flags;
+	response_ttl = reply->ttl;
+	window_size = reply->window;
+	dst_seq = reply->seq;
 
 	/* Check to make sure we got a SYN/ACK like expected */
-	if(syn_resp_tcp && response_flags != (TCP::SYN | TCP::ACK)) {
+	if(response_flags != (TCP::SYN | TCP::ACK)) {
 		if(response_flags & TCP::RST) {
 			result = REJECT;
-			LOG_DEBUG("Scanning %s: Rejected connection.\n", addr.c_str());
+			LOG_DEBUG("Scanning %s: Rejected connection.\n", address_to_string());
 		} else {
 			result = FLAGS_ERROR;
-			LOG_DEBUG("Scanning %s: TCP Error.\n", addr.c_str());
+			LOG_DEBUG("Scanning %s: TCP Error.\n", address_to_string());
+		}
+		return true;
+	}
+
+	options |= reply->options;
+	if(reply->unknown_option >= 0) {
+		fprintf(stderr, "warning: Unknown TCP option kind: %d\n", reply->unknown_option);
+	}
+
+	/* A confident signature match settles the result from the SYN/ACK alone,
+	   before the option and window checks below, since signatures can look
+	   at the whole option layout. Anything less goes on as without them. */
+	if(config.signatures) {
+		const Signature* sig = config.signatures->match(*reply, syn_ip_id, SCAN_SYN_TSVAL);
+		if(sig && sig->confidence >= config.signature_threshold) {
+			result = sig->result;
+			confidence = sig->confidence;
+			LOG_DEBUG("Scanning %s: Matched signature %s.\n", address_to_string(), sig->name.c_str());
+			return true;
 		}
-		goto cleanup;
 	}
 
 	/* Check to see if the SYN/ACK contained any TCP options */
-	if(0 < get_tcp_option_count(syn_resp) && options != SCAN_OPT_MSS) {
+	if(0 < reply->option_count && options != SCAN_OPT_MSS) {
 		result = REAL_HOST;
-		LOG_DEBUG("Scanning %s: Detected real host.\n", addr.c_str());
-		goto cleanup;
+		LOG_DEBUG("Scanning %s: Detected real host.\n", address_to_string());
+		return true;
 	}
 
 	/* Check to see if the window size is above the threshold */
 	if(window_size > config.win_threshold) {
 		result = REAL_HOST;
-		LOG_DEBUG("Scanning %s: Detected real host.\n", addr.c_str());
-		goto cleanup;
+		LOG_DEBUG("Scanning %s: Detected real host.\n", address_to_string());
+		return true;
 	}
 
 	/* In fast scan mode, we stop here, and identify this host as a tarpit */
 	if(config.fast_scan) {
 		result = TARPIT;
-		LOG_DEBUG("Scanning %s: Detected tarpit (Fast scan enabled).\n", addr.c_str());
-		goto cleanup;
+		LOG_DEBUG("Scanning %s: Detected tarpit (Fast scan enabled).\n", address_to_string());
+		return true;
 	}
 
-	/* In non-fast scan mode, finish the 3-way handshake by sending the final ACK */
-	ack = create_ack(dev);
-	ack_resp = send_with_response(dev, ack, timeout, retries, NULL);
-
-	/* Check to see if we got an ACK response. IPTABLES tarpit will respond to our ACK
-	   with a zero-window ACK. Otherwise, if the SYN/ACK window was zero, but now the
-	   host has a non-zero ACK, then this is a real "zero window"  host. */
-	if(ack_resp) {
-		ack_resp_tcp = ack_resp->GetLayer<TCP>();
-		if(ack_resp_tcp) {
-			if(ack_resp_tcp->GetFlags() & TCP::RST) {
-				result = DELUDE;
-				goto cleanup;
-			} else if(ack_resp_tcp->GetWindowsSize() == 0) {
-				result = IPTABLES;
-				LOG_DEBUG("Scanning %s: Detected IPTABLES\n", addr.c_str());
-				goto cleanup;
-			} else if(window_size == 0) {
-				result = ZERO_WIN;
-				goto cleanup;
-			}
+	return false;
+}
+
+/* Check to see if we got an ACK response. IPTABLES tarpit will respond to our ACK
+   with a zero-window ACK. Otherwise, if the SYN/ACK window was zero, but now the
+   host has a non-zero ACK, then this is a real "zero window"  host. */
+bool Scan::on_ack_reply(const ReplyInfo* reply) {
+	if(reply && reply->protocol == IPPROTO_TCP) {
+		if(reply->tcp_flags & TCP::RST) {
+			result = DELUDE;
+			return true;
+		} else if(reply->window == 0) {
+			result = IPTABLES;
+			LOG_DEBUG("Scanning %s: Detected IPTABLES\n", address_to_string());
+			return true;
+		} else if(window_size == 0) {
+			result = ZERO_WIN;
+			return true;
 		}
 	}
+	return false;
+}
 
-	/* Now try sending a data packet with size one less than the window */
-	data = create_data_packet(dev, window_size - 1);
-	data_resp = send_with_response(dev, data, timeout, retries, NULL);
-
-	/* Getting a valid response to the data packet indicates a real host that happens to have a small window size */
-	if(data_resp) {
+/* Getting a valid response to the data packet indicates a real host that happens to have a small window size */
+void Scan::on_data_reply(const ReplyInfo* reply) {
+	if(reply) {
 		result = REAL_HOST;
-		LOG_DEBUG("Scanning %s: Detected real host (with small window).\n", addr.c_str());
+		LOG_DEBUG("Scanning %s: Detected real host (with small window).\n", address_to_string());
 	} else {
 		result = LABREA;
-		LOG_DEBUG("Scanning %s: Detected LABREA\n", addr.c_str());
-	}
-
-cleanup:
-	rst = create_reset_packet(dev);
-	if(!dry_run) {
-		rst->Send(dev);
-		dump_packet(rst);
-	}
-
-	if(rst)			delete rst;
-	if(syn)			delete syn;
-	if(syn_resp)	delete syn_resp;
-	if(ack)			delete ack;
-	if(ack_resp)	delete ack_resp;
-	if(data)		delete data;
-	if(data_resp)	delete data_resp;
-	if(fin)			delete fin;
-	if(fin_resp)	delete fin_resp;
-
-	if(result != NO_RESPONSE) {
-		return true;
+		LOG_DEBUG("Scanning %s: Detected LABREA\n", address_to_string());
 	}
-	return false;
 }
 
-Packet* Scan::create_syn(string dev, uint16_t timeout, uint16_t retries) {
-uint16_t opt_count = 0;
-	Packet* p = new Packet();
-	IP ip;
-	TCP tcp;
+void Scan::finish() {
+	DEGREASER_PROBE4(classify, ia.s_addr, result, window_size, options);
+	commit_capture();
+}
 
-	/* Set data fields for IP and TCP layers */
-	ip.SetSourceIP(GetMyIP(dev));
-	ip.SetDestinationIP(addr);
-	tcp.SetSrcPort(src_port);	
-	tcp.SetDstPort(dst_port);
-	tcp.SetFlags(TCP::SYN);
-	tcp.SetSeqNumber(src_seq);
+/* Same options, in the same order, as create_syn() */
+static uint8_t build_syn_options(uint32_t send_options, uint8_t* opt) {
+	uint8_t len = 0;
 
-	p->PushLayer(ip);
-	p->PushLayer(tcp);
-
-	// Add on TCP options
 	if(send_options & SCAN_OPT_SACK) {
-		p->PushLayer(sack);
-		opt_count += sack.GetLength();
+		opt[len++] = 4;
+		opt[len++] = 2;
 	}
 	if(send_options & SCAN_OPT_WINSCALE) {
-		p->PushLayer(win_scale);
-		opt_count += win_scale.GetLength();
+		opt[len++] = 3;
+		opt[len++] = 3;
+		opt[len++] = 7;
 	}
 	if(send_options & SCAN_OPT_TIMESTAMP) {
-		p->PushLayer(timestamp);
-		opt_count += timestamp.GetLength();
+		const uint8_t ts[] = { 8, 10, SCAN_SYN_TSVAL >> 24, (SCAN_SYN_TSVAL >> 16) & 0xff,
+				(SCAN_SYN_TSVAL >> 8) & 0xff, SCAN_SYN_TSVAL & 0xff, 0, 0, 0, 0 };
+		memcpy(opt + len, ts, sizeof(ts));
+		len += sizeof(ts);
 	}
 	if(send_options & SCAN_OPT_MSS) {
-		p->PushLayer(mss);
-		opt_count += mss.GetLength();
+		opt[len++] = 2;
+		opt[len++] = 4;
+		opt[len++] = 1234 >> 8;
+		opt[len++] = 1234 & 0xff;
 	}
-	
+
 	/* Pad the options to multiple of 4 bytes and add EOL option */
-	if(opt_count > 0) {
-		switch(opt_count % 4) {
-			case 0:	p->PushLayer(TCPOption::NOP);
-			case 1:	p->PushLayer(TCPOption::NOP);
-			case 2:	p->PushLayer(TCPOption::NOP);
-			case 3:	p->PushLayer(TCPOption::EOL);
+	if(len > 0) {
+		switch(len % 4) {
+			case 0:	opt[len++] = 1;
+			case 1:	opt[len++] = 1;
+			case 2:	opt[len++] = 1;
+			case 3:	opt[len++] = 0;
 		}
 	}
-	return p;
+	return len;
 }
 
-Packet* Scan::create_ack(string dev) {
+size_t Scan::build_raw(ScanPacket type, uint32_t src_addr, uint8_t* buf, size_t size) {
+	TcpPacketSpec spec;
+	uint8_t opt[40];
+	uint8_t payload[MAX_DATA_PACKET_SIZE];
+
+	memset(&spec, 0, sizeof(spec));
+	spec.src_addr = src_addr;
+	spec.dst_addr = ia.s_addr;
+	spec.src_port = src_port;
+	spec.dst_port = dst_port;
+	spec.ip_id = prng_next32();
+	spec.window = 5840;
+	spec.ack = dst_seq + 1;
+
+	switch(type) {
+		case SCAN_PACKET_SYN:
+			spec.flags = SCAN_FLAG_SYN;
+			spec.ip_id = syn_ip_id;
+			spec.seq = syn_seq;
+			spec.ack = 0;
+			spec.options = opt;
+			spec.options_len = build_syn_options(send_options, opt);
+			break;
+		case SCAN_PACKET_ACK:
+			spec.flags = SCAN_FLAG_ACK;
+			spec.seq = src_seq;
+			break;
+		case SCAN_PACKET_DATA:
+			spec.flags = SCAN_FLAG_ACK;
+			spec.seq = src_seq;
+			spec.payload = payload;
+			spec.payload_len = window_size - 1 > MAX_DATA_PACKET_SIZE ? MAX_DATA_PACKET_SIZE : (uint16_t)(window_size - 1);
+			prng_fill(payload, spec.payload_len);
+			break;
+		case SCAN_PACKET_RST:
+			spec.flags = SCAN_FLAG_RST | SCAN_FLAG_ACK;
+			spec.seq = src_seq + 1;
+			break;
+	}
+
+	return packet_build_tcp(buf, size, spec);
+}
+
+string Scan::source_ip(string dev) {
+	TRACE_BEGIN(TRACE_GET_MY_IP);
+	string ip = GetMyIP(dev);
+	TRACE_END(TRACE_GET_MY_IP);
+	return ip;
+}
+
+/* A packet with the IP and TCP layers every packet of the sequence starts
+   with. Fields that change from host to host are set by update_packet(). */
+Packet* Scan::new_packet(string dev, uint16_t flags) {
 	Packet* p = new Packet();
 	IP ip;
 	TCP tcp;
 
-	/* Set data fields for IP and TCP layers */
-	ip.SetSourceIP(GetMyIP(dev));
-	ip.SetDestinationIP(addr);
-	tcp.SetSrcPort(src_port);	
-	tcp.SetDstPort(dst_port);
-	tcp.SetFlags(TCP::ACK);
-	tcp.SetSeqNumber(src_seq);
-	tcp.SetAckNumber(dst_seq + 1);
+	if(src_ip.empty()) {
+		src_ip = source_ip(dev);
+	}
+	ip.SetSourceIP(src_ip);
+	tcp.SetFlags(flags);
 
 	p->PushLayer(ip);
 	p->PushLayer(tcp);
-
 	return p;
 }
 
-Packet* Scan::create_data_packet(string dev, uint16_t size) {
-	Packet* p = new Packet();
-	IP ip;
-	TCP tcp;
-	RawLayer data;
-
-	if(size > MAX_DATA_PACKET_SIZE) {
-		size = MAX_DATA_PACKET_SIZE;
-	}
+/* Point p at the current host and connection and re-craft it */
+void Scan::update_packet(Packet* p, uint16_t ip_id, uint32_t seq, uint32_t ack) {
+	IP* ip = p->GetLayer<IP>();
+	TCP* tcp = p->GetLayer<TCP>();
+
+	ip->SetDestinationIP(address_to_string());
+	ip->SetIdentification(ip_id);
+	tcp->SetSrcPort(src_port);
+	tcp->SetDstPort(dst_port);
+	tcp->SetSeqNumber(seq);
+	tcp->SetAckNumber(ack);
+	p->Craft();
+}
 
-	void* buffer = malloc(size);
-	FILE* fd = fopen("/dev/urandom", "r");
-	if(!fd) {
-		fprintf(stderr, "warning: Failed to open /dev/urandom. Data packet will not be random!\n");
-	} else {
-		size = fread(buffer, 1, size, fd);
+Packet* Scan::create_syn(string dev) {
+	/* The options only change with send_options */
+	if(syn_packet && syn_packet_options != send_options) {
+		delete syn_packet;
+		syn_packet = NULL;
 	}
 
-	data.SetPayload((byte*)buffer, size);
+	if(!syn_packet) {
+		uint16_t opt_count = 0;
+		TCPOption win_scale;
+		TCPOptionTimestamp timestamp;
+		TCPOptionMaxSegSize mss;
+		TCPOption sack;
+
+		timestamp.SetValue(SCAN_SYN_TSVAL);
+		win_scale.SetKind(3);
+		win_scale.SetPayload("\x7");
+		win_scale.SetLength(3);
+		mss.SetMaxSegSize(1234);
+		sack.SetKind(4);
+		sack.SetLength(2);
+
+		syn_packet = new_packet(dev, TCP::SYN);
+		syn_packet_options = send_options;
+
+		// Add on TCP options
+		if(send_options & SCAN_OPT_SACK) {
+			syn_packet->PushLayer(sack);
+			opt_count += sack.GetLength();
+		}
+		if(send_options & SCAN_OPT_WINSCALE) {
+			syn_packet->PushLayer(win_scale);
+			opt_count += win_scale.GetLength();
+		}
+		if(send_options & SCAN_OPT_TIMESTAMP) {
+			syn_packet->PushLayer(timestamp);
+			opt_count += timestamp.GetLength();
+		}
+		if(send_options & SCAN_OPT_MSS) {
+			syn_packet->PushLayer(mss);
+			opt_count += mss.GetLength();
+		}
 
-	free(buffer);
-	if(fd) {
-		fclose(fd);
+		/* Pad the options to multiple of 4 bytes and add EOL option */
+		if(opt_count > 0) {
+			switch(opt_count % 4) {
+				case 0:	syn_packet->PushLayer(TCPOption::NOP);
+				case 1:	syn_packet->PushLayer(TCPOption::NOP);
+				case 2:	syn_packet->PushLayer(TCPOption::NOP);
+				case 3:	syn_packet->PushLayer(TCPOption::EOL);
+			}
+		}
 	}
 
-	/* Set data fields for IP and TCP layers */
-	ip.SetSourceIP(GetMyIP(dev));
-	ip.SetDestinationIP(addr);
-	tcp.SetSrcPort(src_port);	
-	tcp.SetDstPort(dst_port);
-	tcp.SetSeqNumber(src_seq);
-	tcp.SetAckNumber(dst_seq + 1);
-	tcp.SetFlags(TCP::ACK);
-
-	p->PushLayer(ip);
-	p->PushLayer(tcp);
-	p->PushLayer(data);
+	update_packet(syn_packet, syn_ip_id, syn_seq, 0);
+	return syn_packet;
+}
 
-	return p;
+Packet* Scan::create_ack(string dev) {
+	if(!ack_packet) {
+		ack_packet = new_packet(dev, TCP::ACK);
+	}
+	update_packet(ack_packet, prng_next32(), src_seq, dst_seq + 1);
+	return ack_packet;
 }
 
-Packet* Scan::create_reset_packet(string dev) {
-	Packet* p = new Packet();
-	IP ip;
-	TCP tcp;
+Packet* Scan::create_data_packet(string dev, uint16_t size) {
+	byte buffer[MAX_DATA_PACKET_SIZE];
 
-	/* Set data fields for IP and TCP layers */
-	ip.SetSourceIP(GetMyIP(dev));
-	ip.SetDestinationIP(addr);
-	tcp.SetSrcPort(src_port);	
-	tcp.SetDstPort(dst_port);
-	tcp.SetFlags(TCP::RST | TCP::ACK);
-	tcp.SetSeqNumber(src_seq + 1);
-	tcp.SetAckNumber(dst_seq + 1);
+	if(size > MAX_DATA_PACKET_SIZE) {
+		size = MAX_DATA_PACKET_SIZE;
+	}
 
-	p->PushLayer(ip);
-	p->PushLayer(tcp);
+	if(!data_packet) {
+		RawLayer data;
+		data_packet = new_packet(dev, TCP::ACK);
+		data_packet->PushLayer(data);
+	}
 
-	return p;
+	prng_fill(buffer, size);
+	data_packet->GetLayer<RawLayer>()->SetPayload(buffer, size);
+	update_packet(data_packet, prng_next32(), src_seq, dst_seq + 1);
+	return data_packet;
 }
 
-Packet* Scan::create_fin_packet(string dev) {
-	Packet* p = new Packet();
-	IP ip;
-	TCP tcp;
-
-	/* Set data fields for IP and TCP layers */
-	ip.SetSourceIP(GetMyIP(dev));
-	ip.SetDestinationIP(addr);
-	tcp.SetSrcPort(src_port);	
-	tcp.SetDstPort(dst_port);
-	tcp.SetFlags(TCP::FIN | TCP::ACK);
-	tcp.SetSeqNumber(src_seq);
-	tcp.SetAckNumber(dst_seq + 1);
-
-	p->PushLayer(ip);
-	p->PushLayer(tcp);
-
-	return p;
+Packet* Scan::create_reset_packet(string dev) {
+	if(!rst_packet) {
+		rst_packet = new_packet(dev, TCP::RST | TCP::ACK);
+	}
+	update_packet(rst_packet, prng_next32(), src_seq + 1, dst_seq + 1);
+	return rst_packet;
 }
 
-Packet* Scan::send_with_response(string dev, Packet* pkt, uint16_t timeout, uint16_t retries, uint32_t* rtime) {
+/* Send pkt and decode the reply into resp. The reply is parsed in place from
+   the captured frame, so nothing beyond libcrafter's own Packet is allocated. */
+bool Scan::send_with_response(string dev, Packet* pkt, uint16_t timeout, uint16_t retries, uint32_t* rtime, ReplyInfo* reply) {
 	struct timeval start_time;
 	struct timeval end_time;
-	Packet* resp = NULL, *ip_resp;
+	Packet* resp = NULL;
 
 	dump_packet(pkt);
 	
 	/* Get the time, then send packet and wait for response. */
 	gettimeofday(&start_time, NULL);
-	if(!dry_run) {
+	if(!config.dry_run) {
+		DEGREASER_PROBE3(probe_send, ia.s_addr, src_port, dst_port);
+		TRACE_BEGIN(TRACE_SEND_RECV);
 		resp = pkt->SendRecv(dev, timeout, retries);
+		TRACE_END(TRACE_SEND_RECV);
+		STATS_INC(packets_sent);
 	}
 	gettimeofday(&end_time, NULL);
 
 	/* No response received */
 	if(!resp) {
-		return NULL;
+		if(!config.dry_run) {
+			DEGREASER_PROBE2(reply_timeout, ia.s_addr, src_port);
+		}
+		return false;
 	}
+	STATS_INC(packets_recv);
 
+	uint32_t elapsed = (end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec);
+	DEGREASER_PROBE3(reply_recv, ia.s_addr, src_port, elapsed);
 	if(rtime) {
-		*rtime = (end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec);
+		*rtime = elapsed;
 	}
 
-	/* Remove the Ethernet header */
-	ip_resp = new Packet();
-	*ip_resp = resp->SubPacket(1, resp->GetLayerCount());
-	delete resp;
+	/* Decode from whichever link header the device captures with: Ethernet,
+	   Linux cooked or none at all. Anything that is not a well formed IPv4
+	   packet is reported as a non-TCP response. */
+	TRACE_BEGIN(TRACE_PARSE);
+	bool parsed;
+	if(resp->GetLayer<Ethernet>()) {
+		parsed = reply_parse_ethernet(resp->GetRawPtr(), resp->GetSize(), reply);
+	} else if(resp->GetLayer<SLL>()) {
+		parsed = reply_parse_sll(resp->GetRawPtr(), resp->GetSize(), reply);
+	} else {
+		parsed = reply_parse_ip(resp->GetRawPtr(), resp->GetSize(), reply);
+	}
+	if(!parsed) {
+		reply->protocol = 0;
+	}
+	TRACE_END(TRACE_PARSE);
 
-	dump_packet(ip_resp);
+	/* Capture only the IP portion, as the outgoing packets are. Without a
+	   parsed IP header there is nothing to put in a raw IP capture. */
+	if(parsed) {
+		dump_raw(reply->ip, reply->ip_caplen);
+	}
+	delete resp;
 
-	return ip_resp;
+	return true;
 }
 
-uint8_t Scan::get_tcp_option_count(Packet* p) {
-	int lcount = p->GetLayerCount();
-	int count = 0;
-	for(int i = 0; i < lcount; i++) {
-		TCPOptionLayer* opt = p->GetLayer<TCPOptionLayer>(i);
-		if(opt) {
-			count++;
-			switch(opt->GetKind()) {
-				case 0:
-				case 1: break;
-				case 2: options |= SCAN_OPT_MSS; break;
-				case 3: options |= SCAN_OPT_WINSCALE; break;
-				case 4:
-				case 5: options |= SCAN_OPT_SACK; break;
-				case 8: options |= SCAN_OPT_TIMESTAMP; break;
-				default:
-						fprintf(stderr, "warning: Unknown TCP option kind: %d\n", opt->GetKind());
-						break;
-			}
-		}
-	}
-	return count;
+void Scan::dump_packet(Packet* p) {
+	dump_raw(p->GetRawPtr(), p->GetSize());
 }
 
-void Scan::dump_packet(Packet* p) {
-	struct pcap_pkthdr header;
+void Scan::dump_raw(const uint8_t* data, size_t size) {
+	struct timeval ts;
 
-	if(config.pcap_dumper == NULL) {
+	if(config.pcap == NULL) {
 		return;
 	}
 
-	gettimeofday(&header.ts, NULL);
-	header.len = p->GetSize();
-	header.caplen = p->GetSize();
-
-	pthread_mutex_lock(&config.pcap_lock);
-	DumperPcap(config.pcap_dumper, &header, p->GetRawPtr());
-	pthread_mutex_unlock(&config.pcap_lock);
-}
-
-const char* Scan::address_to_string() {
-	uint32_t be_addr = htonl(ia.s_addr);
-	uint8_t* be_bytes = (uint8_t*)&be_addr;
-	snprintf(address_str, 16, "%hhu.%hhu.%hhu.%hhu",
-			be_bytes[3], be_bytes[2], be_bytes[1], be_bytes[0]);
-	return address_str;
-}
-
-const char* Scan::result_to_string() {
-	switch(result) {
-		case UNREACHABLE:	return "Unreachable";
-		case NOT_SCANNED:	return "Not scanned";
-		case NO_RESPONSE:	return "No response";
-		case REJECT:		return "Rejecting";
-		case FLAGS_ERROR:	return "Bad Flags";
-		case REAL_HOST:		return "Real Host";
-		case LABREA:		return "Labrea";
-		case IPTABLES:		return "iptables - tarpit";
-		case DELUDE:		return "iptables - delude";
-		case TCP_ERROR:		return "Error in TCP packet";
-		case DRY_RUN:		return "Not scanned. Running in dry run mode.";
-		case TARPIT:		return "Tarpit";
-		case ZERO_WIN:		return "Zero Window";
-		default:			return "Unknown Result";
+	TRACE_BEGIN(TRACE_PCAP);
+	gettimeofday(&ts, NULL);
+	if(config.pcap_filter == 0) {
+		config.pcap->write_packet(data, size, ts);
+	} else {
+		/* Selective capture: hold the packet until the scan has a result.
+		   Packets are truncated to the headers, and dropped if the buffer is
+		   full, which only happens for unusually chatty hosts. */
+		uint16_t len = size;
+		uint16_t caplen = len > CAPTURE_SNAPLEN ? CAPTURE_SNAPLEN : len;
+		if(!capture_buf) {
+			capture_buf = new uint8_t[CAPTURE_BUF_SIZE];
+		}
+		if(capture_used + CAPTURE_ENTRY_SIZE(caplen) <= CAPTURE_BUF_SIZE) {
+			CapturedPacket* cp = (CapturedPacket*)(capture_buf + capture_used);
+			cp->ts = ts;
+			cp->caplen = caplen;
+			cp->len = len;
+			memcpy(cp + 1, data, caplen);
+			capture_used += CAPTURE_ENTRY_SIZE(caplen);
+		}
 	}
+	TRACE_END(TRACE_PCAP);
 }
 
-const char* Scan::options_to_string() {
-	char* opt_ptr = opt_str;
+/* Write out the packets held for selective capture if the result matched */
+void Scan::commit_capture() {
+	uint16_t offset = 0;
 
-	if(options & SCAN_OPT_MSS)			*opt_ptr++ = 'M';
-	if(options & SCAN_OPT_WINSCALE)		*opt_ptr++ = 'W';
-	if(options & SCAN_OPT_SACK)			*opt_ptr++ = 'S';
-	if(options & SCAN_OPT_TIMESTAMP)	*opt_ptr++ = 'T';
-	*opt_ptr = '\0';
+	if(config.pcap == NULL || config.pcap_filter == 0) {
+		return;
+	}
 
-	return opt_str;
+	if(config.pcap_filter & SCAN_RESULT_BIT(result)) {
+		while(offset < capture_used) {
+			CapturedPacket* cp = (CapturedPacket*)(capture_buf + offset);
+			config.pcap->write_packet((const uint8_t*)(cp + 1), cp->caplen, cp->len, cp->ts);
+			offset += CAPTURE_ENTRY_SIZE(cp->caplen);
+		}
+	}
+	capture_used = 0;
 }
 
-const char* Scan::flags_to_string() {
-	char* flag_ptr = flags_str;
-
-	if(response_flags & TCP::SYN)	*flag_ptr++ = 'S';
-	if(response_flags & TCP::ACK)	*flag_ptr++ = 'A';
-	if(response_flags & TCP::FIN)	*flag_ptr++ = 'F';
-	if(response_flags & TCP::RST)	*flag_ptr++ = 'R';
-	*flag_ptr = '\0';
+const char* Scan::address_to_string() {
+	return inet_ntop(AF_INET, &ia, address_str, sizeof(address_str));
+}
 
-	return flags_str;
+void Scan::to_record(ScanRecord* r) const {
+	r->addr = ia.s_addr;
+	r->timestamp = scan_time;
+	r->response_time = response_time;
+	r->window_size = window_size;
+	r->src_port = src_port;
+	r->dst_port = dst_port;
+	r->result = result;
+	r->flags = response_flags;
+	r->options = options;
+	r->confidence = confidence;
+	r->ttl = response_ttl;
+	/* Scans are reset with every bit set to send all options; only the
+	   real option flags belong in the record */
+	r->send_options = send_options & (SCAN_OPT_SACK | SCAN_OPT_TIMESTAMP | SCAN_OPT_WINSCALE | SCAN_OPT_MSS);
+	r->icmp_router = icmp_router;
+	r->icmp_code = icmp_code;
+	memset(r->reserved, 0, sizeof(r->reserved));
 }
 
-bool Scan::dry_run = false;
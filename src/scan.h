@@ -29,78 +29,109 @@
 
 #include "degreaser.h"
 #include "subnet_list.h"
+#include "scan_record.h"
+#include "reply_parser.h"
 
 using namespace Crafter;
 
-#define SCAN_OPT_SACK		(1<<1)
-#define SCAN_OPT_TIMESTAMP	(1<<2)
-#define SCAN_OPT_WINSCALE	(1<<3)
-#define SCAN_OPT_MSS		(1<<4)
-
-/* Possible results from a scan. Errors should be negative. */
-enum ScanResult {	UNREACHABLE	= -4,
-					DRY_RUN		= -3,
-					FLAGS_ERROR = -2,
-					TCP_ERROR	= -1,
-					NOT_SCANNED = 0,
-					NO_RESPONSE = 1,
-					REAL_HOST	= 2,
-					REJECT		= 3,
-					LABREA		= 4,
-					IPTABLES	= 5,
-					TARPIT		= 6,
-					DELUDE		= 7,
-					ZERO_WIN	= 8 };
+/* TSval of the timestamp option in our SYNs */
+#define SCAN_SYN_TSVAL		0x00abcfef
 
+/* Packets of the scan sequence, for building raw packets */
+enum ScanPacket {	SCAN_PACKET_SYN,
+					SCAN_PACKET_ACK,
+					SCAN_PACKET_DATA,
+					SCAN_PACKET_RST };
+
+/* State for scanning one host. Scans are meant to be reused: reset()
+   readies the object for the next target without allocating, and the
+   result leaves through to_record(). The libcrafter packets scan() sends
+   are built on first use and then only have their per-host fields updated,
+   so a reused Scan builds its packets and TCP options once. */
 class Scan {
 	public:
 		Scan(DegreaserConfig& c, uint32_t a, uint32_t o);
 		~Scan(); 
 
+		void reset(uint32_t a, uint32_t o);
+
 		bool scan(string dev, uint16_t dst_port, uint16_t src_port, uint16_t timeout, uint16_t retries);
+
+		/* Steppable form of scan(), for callers that do their own sending and
+		   receiving. Each on_*_reply() takes the reply to the matching packet,
+		   or NULL if it timed out, and returns true once the result is known.
+		   After that, send the RST and call finish(). */
+		void begin(uint16_t dst_port, uint16_t src_port);
+		bool on_syn_reply(const ReplyInfo* reply);
+		bool on_ack_reply(const ReplyInfo* reply);
+		void on_data_reply(const ReplyInfo* reply);
+		void finish();
+
+		/* Build the given packet of the sequence into buf. Returns its length. */
+		size_t build_raw(ScanPacket type, uint32_t src_addr, uint8_t* buf, size_t size);
+		void dump_raw(const uint8_t* data, size_t size);
 		ScanResult get_result() const;
 
 		DegreaserConfig& config;
 		in_addr ia;
-		string addr;
 		uint32_t send_options;
 		uint32_t options;
 		uint32_t response_time;
 		uint32_t window_size;
+		uint32_t scan_time;
+		uint8_t confidence;
+		uint8_t response_ttl;
+		uint8_t icmp_code;			/* Of the ICMP error, for UNREACHABLE results */
+		uint32_t icmp_router;		/* Sender of the ICMP error (network byte order) */
 		uint16_t response_flags;
-		TCPOption win_scale;
-		TCPOptionTimestamp timestamp;
-		TCPOptionMaxSegSize mss;
-		TCPOption sack;
 
 		const char* address_to_string();
-		const char* options_to_string();
-		const char* flags_to_string();
-		const char* result_to_string();
 
-		static bool dry_run;
+		void to_record(ScanRecord* r) const;
+
 	private:
-		Packet* create_syn(string dev, uint16_t timeout, uint16_t retries);
+		string source_ip(string dev);
+		Packet* create_syn(string dev);
 		Packet* create_ack(string dev);
 		Packet* create_data_packet(string dev, uint16_t size);
 		Packet* create_reset_packet(string dev);
-		Packet* create_fin_packet(string dev);
-		Packet* send_with_response(string dev, Packet* pkt, uint16_t timeout, uint16_t retries, uint32_t* rtime);
-		bool parse_response(Packet* resp);
-		uint8_t get_tcp_option_count(Packet* p);
+		Packet* new_packet(string dev, uint16_t flags);
+		void update_packet(Packet* p, uint16_t ip_id, uint32_t seq, uint32_t ack);
+		bool send_with_response(string dev, Packet* pkt, uint16_t timeout, uint16_t retries, uint32_t* rtime, ReplyInfo* reply);
 		bool is_restricted();
 		void dump_packet(Packet* p);
+		void commit_capture();
 
 		ScanResult result;
 		uint16_t src_port;
 		uint16_t dst_port;
+		uint32_t syn_seq;
+		uint16_t syn_ip_id;
 		uint32_t src_seq;
 		uint32_t dst_seq;
 		char address_str[16];
-		char opt_str[5];
-		char flags_str[5];
+
+		/* Packets of scan(), NULL until first used */
+		Packet* syn_packet;
+		uint32_t syn_packet_options;	/* send_options syn_packet was built with */
+		Packet* ack_packet;
+		Packet* data_packet;
+		Packet* rst_packet;
+		string src_ip;
+
+		/* Packets held back for selective capture until the result is known.
+		   Each entry is a CapturedPacket header followed by the packet bytes. */
+		struct CapturedPacket {
+			struct timeval ts;
+			uint16_t caplen;
+			uint16_t len;
+		};
+		uint8_t* capture_buf;		/* CAPTURE_BUF_SIZE bytes, allocated on first use */
+		uint16_t capture_used;
 
 		const static uint16_t MAX_DATA_PACKET_SIZE = 100;
+		const static uint16_t CAPTURE_SNAPLEN = 256;
+		const static uint16_t CAPTURE_BUF_SIZE = 2048;
 };
 
 #endif /* SCAN_H */
@@ -0,0 +1,110 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "scan_record.h"
+
+/* Short machine-readable names, used on the command line */
+static const struct {
+	int result;
+	const char* name;
+} result_names[] = {
+	{ UNREACHABLE,	"unreachable" },
+	{ DRY_RUN,		"dry_run" },
+	{ FLAGS_ERROR,	"flags_error" },
+	{ TCP_ERROR,	"tcp_error" },
+	{ NOT_SCANNED,	"not_scanned" },
+	{ NO_RESPONSE,	"no_response" },
+	{ REAL_HOST,	"real_host" },
+	{ REJECT,		"reject" },
+	{ LABREA,		"labrea" },
+	{ IPTABLES,		"iptables" },
+	{ TARPIT,		"tarpit" },
+	{ DELUDE,		"delude" },
+	{ ZERO_WIN,		"zero_window" },
+	{ 0,			NULL }
+};
+
+const char* scan_result_to_string(int result) {
+	switch(result) {
+		case UNREACHABLE:	return "Unreachable";
+		case NOT_SCANNED:	return "Not scanned";
+		case NO_RESPONSE:	return "No response";
+		case REJECT:		return "Rejecting";
+		case FLAGS_ERROR:	return "Bad Flags";
+		case REAL_HOST:		return "Real Host";
+		case LABREA:		return "Labrea";
+		case IPTABLES:		return "iptables - tarpit";
+		case DELUDE:		return "iptables - delude";
+		case TCP_ERROR:		return "Error in TCP packet";
+		case DRY_RUN:		return "Not scanned. Running in dry run mode.";
+		case TARPIT:		return "Tarpit";
+		case ZERO_WIN:		return "Zero Window";
+		default:			return "Unknown Result";
+	}
+}
+
+const char* scan_result_to_name(int result) {
+	for(int i = 0; result_names[i].name; i++) {
+		if(result_names[i].result == result) {
+			return result_names[i].name;
+		}
+	}
+	return "unknown";
+}
+
+bool scan_result_from_name(const char* name, int* result) {
+	for(int i = 0; result_names[i].name; i++) {
+		if(0 == strcmp(result_names[i].name, name)) {
+			*result = result_names[i].result;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* buf must hold at least 5 bytes */
+const char* scan_flags_to_string(uint8_t flags, char* buf) {
+	char* flag_ptr = buf;
+
+	if(flags & SCAN_FLAG_SYN)	*flag_ptr++ = 'S';
+	if(flags & SCAN_FLAG_ACK)	*flag_ptr++ = 'A';
+	if(flags & SCAN_FLAG_FIN)	*flag_ptr++ = 'F';
+	if(flags & SCAN_FLAG_RST)	*flag_ptr++ = 'R';
+	*flag_ptr = '\0';
+
+	return buf;
+}
+
+/* buf must hold at least 5 bytes */
+const char* scan_options_to_string(uint8_t options, char* buf) {
+	char* opt_ptr = buf;
+
+	if(options & SCAN_OPT_MSS)			*opt_ptr++ = 'M';
+	if(options & SCAN_OPT_WINSCALE)		*opt_ptr++ = 'W';
+	if(options & SCAN_OPT_SACK)			*opt_ptr++ = 'S';
+	if(options & SCAN_OPT_TIMESTAMP)	*opt_ptr++ = 'T';
+	*opt_ptr = '\0';
+
+	return buf;
+}
@@ -0,0 +1,83 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef SCAN_RECORD_H
+#define SCAN_RECORD_H
+
+#include <stdint.h>
+
+#define SCAN_OPT_SACK		(1<<1)
+#define SCAN_OPT_TIMESTAMP	(1<<2)
+#define SCAN_OPT_WINSCALE	(1<<3)
+#define SCAN_OPT_MSS		(1<<4)
+
+/* Raw TCP header flag bits, as stored in ScanRecord::flags */
+#define SCAN_FLAG_FIN		0x01
+#define SCAN_FLAG_SYN		0x02
+#define SCAN_FLAG_RST		0x04
+#define SCAN_FLAG_ACK		0x10
+
+/* Possible results from a scan. Errors should be negative. */
+enum ScanResult {	UNREACHABLE	= -4,
+					DRY_RUN		= -3,
+					FLAGS_ERROR = -2,
+					TCP_ERROR	= -1,
+					NOT_SCANNED = 0,
+					NO_RESPONSE = 1,
+					REAL_HOST	= 2,
+					REJECT		= 3,
+					LABREA		= 4,
+					IPTABLES	= 5,
+					TARPIT		= 6,
+					DELUDE		= 7,
+					ZERO_WIN	= 8 };
+
+/* Bit for a ScanResult in a result mask */
+#define SCAN_RESULT_BIT(r)	(1u << ((r) - UNREACHABLE))
+
+/* Fixed-width result of a single scan. This is the on-disk record of the
+   binary output format, so the layout must not change without bumping
+   BINARY_FORMAT_VERSION. All fields are host byte order except addr. */
+struct ScanRecord {
+	uint32_t addr;				/* Scanned address (network byte order) */
+	uint32_t timestamp;			/* Time the scan started (seconds since epoch) */
+	uint32_t response_time;		/* SYN/ACK round trip time (microseconds) */
+	uint16_t window_size;		/* Window size advertised in the SYN/ACK */
+	uint16_t src_port;
+	uint16_t dst_port;
+	int8_t result;				/* ScanResult */
+	uint8_t flags;				/* TCP flags of the SYN response */
+	uint8_t options;			/* SCAN_OPT_* bitmask */
+	uint8_t confidence;			/* Certainty of the result, 0-100 (0 in older files) */
+	uint8_t ttl;				/* IP TTL of the SYN response (0 in older files) */
+	uint8_t send_options;		/* SCAN_OPT_* bitmask of the options sent in the SYN */
+	uint32_t icmp_router;		/* Sender of the ICMP error for UNREACHABLE (network byte order) */
+	uint8_t icmp_code;			/* Code of that ICMP error */
+	uint8_t reserved[3];
+};
+
+const char* scan_result_to_string(int result);
+const char* scan_result_to_name(int result);
+bool scan_result_from_name(const char* name, int* result);
+const char* scan_flags_to_string(uint8_t flags, char* buf);
+const char* scan_options_to_string(uint8_t options, char* buf);
+
+#endif /* SCAN_RECORD_H */
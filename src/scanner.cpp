@@ -19,14 +19,29 @@
     ------------------------------------------------------------------------
 */
 
+#include <stdio.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <string>
 
 #include "degreaser.h"
 #include "subnet_list.h"
 #include "scan.h"
+#include "output_writer.h"
+#include "trace.h"
+#include "probes.h"
+#include "pcap_writer.h"
+#include "port_allocator.h"
+#include "prefix_tracker.h"
+#include "result_store.h"
+#include "retry_pass.h"
+#include "unreachable_cache.h"
+#include "engine.h"
+#include "cpu_affinity.h"
 #include "output.h"
 
+#define RETRY_POLL_US	100000
+
 #define IP_ADDRESS(a,b,c,d) (uint32_t)((a<<24) + (b<<16) + (c<<8) + (d))
 
 struct IPv4AddressRange {
@@ -56,82 +71,295 @@ static IPv4AddressRange reserved_addresses[] = {
 };
 
 
-static uint16_t scanner_get_random_port(uint16_t min, uint16_t max);
 static void scanner_add_restricted_addresses(DegreaserConfig* config);
 
-void scanner(DegreaserConfig* config) {
-	uint32_t addr;
+void scanner_defaults(DegreaserConfig* config) {
+	config->device = "";
+	config->max_threads = 10;
+	config->port = 80;
+	config->win_threshold = 20;
+	config->verbose = 1;
+	config->retries = 1;
+	config->timeout = 5;
+	config->all_scans = false;
+	config->dry_run = false;
+	config->random = true;
+	config->fast_scan = false;
+	config->exclude_rfc6890 = true;
+	config->firewall = FIREWALL_AUTO;
+	config->firewall_state = NULL;
+	config->event_engine = false;
+	config->max_inflight = 1024;
+	config->src_port_min = 0;
+	config->src_port_max = 0;
+	config->ports = NULL;
+	config->signatures = NULL;
+	config->signature_threshold = 75;
+	config->prefixes = NULL;
+	config->store = NULL;
+	config->retry = NULL;
+	config->unreachable = NULL;
+	config->subnets = NULL;
+	config->exclude_list = NULL;
+	config->writer = NULL;
+	config->pcap = NULL;
+	config->pcap_filter = 0;
+	pthread_mutex_init(&config->global_lock, NULL);
+}
 
+/* Called once before any scanner threads are started. The exclude list
+   is not modified after this, so scanners can read it without locking. */
+void scanner_init(DegreaserConfig* config) {
 	if(config->exclude_rfc6890) {
 		scanner_add_restricted_addresses(config);
 	}
 
-	/* Keep looping while there are more addressed to scan */
-	while(0 != (addr = config->subnets->next_address())) {
+	/* The firewall picks the window when it sets up its rules. Without one
+	   (dry run, fast scan) use the same default below the usual ephemeral
+	   range. */
+	if(config->src_port_max == 0) {
+		config->src_port_max = 32767;
+		config->src_port_min = config->src_port_max - 1000;
+	}
+	config->ports = new PortAllocator(config->src_port_min, config->src_port_max);
+	if(config->ports->size() < config->max_threads) {
+		fprintf(stderr, "warning: Only %u source ports for %hu threads. Some threads will wait for a free port.\n",
+				config->ports->size(), config->max_threads);
+	}
+}
 
-		pthread_mutex_lock(&config->global_lock);
-		if(config->exclude_list->exists(htonl(addr))) {
-			config->total_excluded++;
-			pthread_mutex_unlock(&config->global_lock);
+uint32_t scanner_next_target(DegreaserConfig* config, bool* done) {
+	uint32_t addr = 0;
+
+	*done = false;
+	if(config->retry && config->retry->retrying()) {
+		goto retry;
+	}
+
+	/* Counted before it is taken; see RetryPass::next_pass() */
+	if(config->retry) {
+		config->retry->started();
+	}
+	while(0 != (addr = config->subnets->next_address())) {
+		bool excluded = config->exclude_list->exists(htonl(addr));
+		DEGREASER_PROBE2(exclude_check, addr, excluded);
+		if(excluded) {
+			STATS_INC(excluded);
+			continue;
+		}
+		if(config->store && !config->store->needs_scan(addr)) {
+			STATS_INC(unchanged);
 			continue;
 		}
-		config->total_scans++;
-		pthread_mutex_unlock(&config->global_lock);
+		if(config->prefixes && config->prefixes->should_skip(addr)) {
+			STATS_INC(skipped);
+			continue;
+		}
+		if(config->unreachable && config->unreachable->should_skip(addr)) {
+			STATS_INC(dark_skipped);
+			continue;
+		}
+		STATS_INC(scans);
+		break;
+	}
 
-		Scan* s = new Scan(*config, addr, 0xffffffff);
-		uint16_t src_port = scanner_get_random_port(config->src_port_min, config->src_port_max);
+	if(!config->retry) {
+		*done = (addr == 0);
+		return addr;
+	}
+	if(addr != 0) {
+		return addr;
+	}
+	config->retry->unstarted();
+	config->retry->list_done();
 
-		/* Perform the scan */
-		if(true == s->scan(config->device, config->port, src_port, config->timeout, config->retries)) {
-			pthread_mutex_lock(&config->global_lock);
-			switch(s->get_result()) {
-				case TARPIT:
-					config->total_tarpits++;
-					break;
-				case LABREA:
-					config->total_tarpits++;
-					config->total_labrea++;
-					break;
-				case IPTABLES:
-					config->total_tarpits++;
-					config->total_iptables++;
-					break;
-				case DELUDE:
-					config->total_delude++;
-					break;
-				case REAL_HOST:
-					config->total_real++;
-					break;
-				case REJECT:
-					config->total_rejecting++;
-					break;
-				case FLAGS_ERROR:
-				case TCP_ERROR:
-					config->total_errors++;
-					break;
-				default:
-					break;
-			}
+retry:
+	switch(config->retry->next(&addr)) {
+		case RETRY_TARGET:
+			STATS_INC(retried);
+			return addr;
+		case RETRY_WAIT:
+			return 0;
+		case RETRY_DONE:
+			break;
+	}
+	*done = true;
+	return 0;
+}
+
+void scanner_complete(DegreaserConfig* config, Scan* s) {
+	/* Silent hosts with a retry pass to come are reported after it */
+	if(config->retry && config->retry->finished(s->ia.s_addr, s->get_result() == NO_RESPONSE)) {
+		return;
+	}
 
-			config->total_hits++;
-			pthread_mutex_unlock(&config->global_lock);
+	if(config->prefixes) {
+		config->prefixes->record(s->ia.s_addr, s->get_result(), s->window_size, s->options, s->response_ttl);
+	}
+	if(config->unreachable) {
+		config->unreachable->record(s->ia.s_addr, s->get_result(), s->icmp_router, s->icmp_code);
+	}
+
+	if(s->get_result() != NO_RESPONSE) {
+		switch(s->get_result()) {
+			case TARPIT:
+				STATS_INC(tarpits);
+				break;
+			case LABREA:
+				STATS_INC(tarpits);
+				STATS_INC(labrea);
+				break;
+			case IPTABLES:
+				STATS_INC(tarpits);
+				STATS_INC(iptables);
+				break;
+			case DELUDE:
+				STATS_INC(delude);
+				break;
+			case REAL_HOST:
+				STATS_INC(real);
+				break;
+			case REJECT:
+				STATS_INC(rejecting);
+				break;
+			case UNREACHABLE:
+				STATS_INC(unreachable);
+				break;
+			case ZERO_WIN:
+				STATS_INC(zero_win);
+				break;
+			case FLAGS_ERROR:
+			case TCP_ERROR:
+				STATS_INC(errors);
+				break;
+			default:
+				break;
 		}
 
-		/* Iterate through all the output modules with the results of this scan */
-		list<Output*>::iterator iter = config->outputs.begin();
-		for(;iter != config->outputs.end(); ++iter) {
-			(*iter)->output_scan(s);
+		STATS_INC(hits);
+		latency_thread()->record(s->get_result(), s->response_time);
+	}
+
+	/* The writer gets a copy of the record, so the scan can be reused */
+	ScanRecord r;
+	s->to_record(&r);
+	config->writer->push(r);
+}
+
+void scanner(DegreaserConfig* config) {
+	uint32_t addr;
+	bool done;
+
+	config->stats.attach();
+	trace_attach("scanner");
+
+	/* One scan per thread, reset for every target */
+	Scan* s = new Scan(*config, 0, 0xffffffff);
+
+	/* Keep looping while there are more addressed to scan */
+	for(;;) {
+		if(0 == (addr = scanner_next_target(config, &done))) {
+			if(done) {
+				break;
+			}
+			/* Waiting for the next retry pass */
+			if(config->pcap) {
+				config->pcap->flush_thread_if_old();
+			}
+			usleep(RETRY_POLL_US);
+			continue;
 		}
+		s->reset(addr, 0xffffffff);
+		uint16_t src_port = config->ports->acquire();
+
+		/* Perform the scan */
+		STATS_INC(in_flight);
+		TRACE_BEGIN(TRACE_SCAN);
+		s->scan(config->device, config->port, src_port, config->timeout, config->retries);
+		TRACE_END(TRACE_SCAN);
+		STATS_DEC(in_flight);
+
+		/* The RST has gone out, so nothing more is expected on this port */
+		config->ports->release(src_port);
+
+		scanner_complete(config, s);
+	}
+	delete s;
 
-		delete s;
+	if(config->pcap) {
+		config->pcap->flush_thread();
 	}
 }
 
-static uint16_t scanner_get_random_port(uint16_t min, uint16_t max) {
-	uint32_t range = max - min;
-	double r = rand();
+bool scanner_run(DegreaserConfig* config) {
+	list<pthread_t> threads;
+	pthread_attr_t attr;
+	pthread_t tid;
+	cpu_set_t caller_cpus;
+	vector<int>& cpus = config->cpus;
+
+	if(config->event_engine && cpus.size() > 0) {
+		if(cpus.size() > (uint32_t)(config->src_port_max - config->src_port_min + 1)) {
+			fprintf(stderr, "error: more workers than source ports\n");
+			return false;
+		}
+		return engine_run_workers(config, cpus, config->max_inflight);
+	} else if(config->event_engine) {
+		ScanEngine* engine = new ScanEngine(config, config->max_inflight, config->src_port_min, config->src_port_max);
+		bool ok = engine->open() && engine->run();
+		delete engine;
+		return ok;
+	}
+
+	/* Scanner threads go round-robin over the selected CPUs, starting
+	   with this one. All of them are checked before anything is scanned.
+	   The caller may be an embedding application's thread, so its own
+	   affinity is put back afterwards. */
+	if(cpus.size() > 0) {
+		for(size_t i = 1; i < cpus.size(); i++) {
+			pthread_attr_init(&attr);
+			bool ok = cpu_attr_pin(&attr, cpus[i]);
+			pthread_attr_destroy(&attr);
+			if(!ok) {
+				return false;
+			}
+		}
+		if(!cpu_pin_self(cpus[0], &caller_cpus)) {
+			return false;
+		}
+	}
+
+	/* Spawn worker threads (if needed) and start scanning */
+	int spawn_delay = config->timeout * 1000000 / config->max_threads;
+	for(int i = 1; i < config->max_threads; i++) {
+		pthread_attr_init(&attr);
+		if(cpus.size() > 0) {
+			cpu_attr_pin(&attr, cpus[i % cpus.size()]);
+		}
+		if(0 != pthread_create(&tid, &attr, (void* (*)(void*))scanner, (void*)config)) {
+			fprintf(stderr, "warning: failed to start scanner thread %d, scanning with %d\n", i + 1, i);
+			pthread_attr_destroy(&attr);
+			break;
+		}
+		pthread_attr_destroy(&attr);
+		config->writer->message("Starting thread %d/%d...", i, config->max_threads);
+		threads.push_back(tid);
+		usleep(spawn_delay);
+	}
+	config->writer->message("");
+
+	scanner(config);
 
-	return (r / RAND_MAX) * range + min;
+	/* Clean up threads */
+	while(threads.size() > 0) {
+		tid = *threads.begin();
+		threads.pop_front();
+		pthread_join(tid, NULL);
+	}
+	if(cpus.size() > 0) {
+		cpu_restore_self(&caller_cpus);
+	}
+	return true;
 }
 
 static void scanner_add_restricted_addresses(DegreaserConfig* config) {
@@ -26,6 +26,27 @@
 
 #include "degreaser.h"
 
+class Scan;
+
+/* Fill in the default configuration */
+void scanner_defaults(DegreaserConfig*);
+
+void scanner_init(DegreaserConfig*);
 void scanner(DegreaserConfig*);
 
+/* Scan all targets with the threaded scanner or the event engine, as
+   configured. Call after scanner_init() with the output writer running;
+   returns once every result has been handed to it. Returns false (after
+   printing why) if the scan could not be started or failed part way. */
+bool scanner_run(DegreaserConfig*);
+
+/* Next address to scan (network byte order), after the exclude list, result
+   store and tarpit range checks. Returns 0 with *done set once the targets
+   run out, or 0 alone if a retry pass is not ready yet. */
+uint32_t scanner_next_target(DegreaserConfig*, bool* done);
+
+/* Record a finished scan in the statistics and queue its record for the
+   outputs. The caller keeps the scan and may reset it for the next target. */
+void scanner_complete(DegreaserConfig*, Scan*);
+
 #endif /* SCANER_H */
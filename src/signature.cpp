@@ -0,0 +1,272 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "signature.h"
+
+/* Built-in signatures, in the signature file format. The iptables TARPIT
+   target and its DELUDE mode answer from the kernel, so with its default
+   TTL of 64, no options and an IP ID computed from the SYN's. TARPIT
+   offers a window of 5 and DELUDE a zero window. LaBrea also sends a small
+   window without options, but picks its own IP ID. A zero window with no
+   options and nothing else to go on is shared by older TARPIT releases and
+   genuinely full hosts, so it is only a hint and still needs the follow-up
+   probes. */
+static const char* default_signatures[] = {
+	"iptables    iptables  5      1-64  negated  -  -  90",
+	"delude      delude    0      1-64  negated  -  -  80",
+	"labrea      labrea    1-10   *     other    -  -  80",
+	"zero-window tarpit    0      *     *        -  -  40",
+	NULL
+};
+
+SignatureTable::SignatureTable() { }
+
+size_t SignatureTable::size() const {
+	return signatures.size();
+}
+
+void SignatureTable::add_defaults() {
+	char line[128];
+	Signature sig;
+
+	for(const char** s = default_signatures; *s; s++) {
+		strncpy(line, *s, sizeof(line) - 1);
+		line[sizeof(line) - 1] = '\0';
+		if(parse_line(line, &sig)) {
+			signatures.push_back(sig);
+		}
+	}
+}
+
+bool SignatureTable::load(const char* filename) {
+	FILE* fd = fopen(filename, "r");
+	char* line = NULL;
+	size_t size;
+	int lineno = 0;
+	bool ok = true;
+	Signature sig;
+
+	if(!fd) {
+		fprintf(stderr, "error: Failed to open signature file '%s'. Reason: %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	while(-1 != getline(&line, &size, fd)) {
+		lineno++;
+
+		char* comment = strchr(line, '#');
+		if(comment) {
+			*comment = '\0';
+		}
+		if(line[strspn(line, " \t\r\n")] == '\0') {
+			continue;
+		}
+
+		if(!parse_line(line, &sig)) {
+			fprintf(stderr, "error: %s:%d: invalid signature\n", filename, lineno);
+			ok = false;
+			break;
+		}
+		signatures.push_back(sig);
+	}
+
+	free(line);
+	fclose(fd);
+	return ok;
+}
+
+/* Parses "n", "min-max" or "*" */
+static bool parse_range(const char* s, uint32_t limit, uint32_t* min, uint32_t* max) {
+	char* end;
+
+	if(0 == strcmp(s, "*")) {
+		*min = 0;
+		*max = limit;
+		return true;
+	}
+
+	*min = *max = strtoul(s, &end, 10);
+	if(*end == '-') {
+		*max = strtoul(end + 1, &end, 10);
+	}
+	return *end == '\0' && *min <= *max && *max <= limit;
+}
+
+/* Parses one of the ipid or timestamp keywords */
+static bool parse_value(const char* s, bool ip_id, SignatureValue* value) {
+	if(0 == strcmp(s, "*")) {
+		*value = SIG_ANY;
+	} else if(0 == strcmp(s, "zero")) {
+		*value = SIG_ZERO;
+	} else if(0 == strcmp(s, "echo")) {
+		*value = SIG_ECHO;
+	} else if(0 == strcmp(s, "other")) {
+		*value = SIG_OTHER;
+	} else if(ip_id && 0 == strcmp(s, "nonzero")) {
+		*value = SIG_NONZERO;
+	} else if(ip_id && 0 == strcmp(s, "negated")) {
+		*value = SIG_NEGATED;
+	} else if(!ip_id && 0 == strcmp(s, "-")) {
+		*value = SIG_ABSENT;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool SignatureTable::parse_line(char* line, Signature* sig) {
+	const char* delim = " \t\r\n";
+	char* fields[8];
+	char* saveptr;
+	uint32_t min, max;
+	int result;
+	int n = 0;
+
+	for(char* tok = strtok_r(line, delim, &saveptr); tok; tok = strtok_r(NULL, delim, &saveptr)) {
+		if(n == 8) {
+			return false;
+		}
+		fields[n++] = tok;
+	}
+	if(n == 7) {
+		/* Older files without the timestamp column */
+		fields[7] = fields[6];
+		fields[6] = (char*)"*";
+	} else if(n != 8) {
+		return false;
+	}
+
+	sig->name = fields[0];
+
+	if(!scan_result_from_name(fields[1], &result)) {
+		return false;
+	}
+	sig->result = (ScanResult)result;
+
+	if(!parse_range(fields[2], 65535, &sig->win_min, &sig->win_max)) {
+		return false;
+	}
+
+	if(!parse_range(fields[3], 255, &min, &max)) {
+		return false;
+	}
+	sig->ttl_min = min;
+	sig->ttl_max = max;
+
+	if(!parse_value(fields[4], true, &sig->ip_id)) {
+		return false;
+	}
+
+	sig->options.clear();
+	sig->any_options = false;
+	if(0 == strcmp(fields[5], "*")) {
+		sig->any_options = true;
+	} else if(0 != strcmp(fields[5], "-")) {
+		char* kind_save;
+		for(char* kind = strtok_r(fields[5], ",", &kind_save); kind; kind = strtok_r(NULL, ",", &kind_save)) {
+			char* end;
+			unsigned long k = strtoul(kind, &end, 10);
+			if(*end != '\0' || k > 255 || sig->options.size() == REPLY_MAX_OPTIONS) {
+				return false;
+			}
+			sig->options.push_back(k);
+		}
+	}
+
+	if(!parse_value(fields[6], false, &sig->timestamp)) {
+		return false;
+	}
+
+	if(!parse_range(fields[7], 100, &min, &max) || min != max) {
+		return false;
+	}
+	sig->confidence = min;
+
+	return true;
+}
+
+/* How the reply's IP ID relates to the one in our SYN. Kernel tarpits
+   negate the ID on the raw network order field, so on little endian hosts
+   the result comes out byte swapped. */
+static SignatureValue ip_id_value(uint16_t id, uint16_t probe) {
+	uint16_t negated = -probe;
+	uint16_t swapped = (probe >> 8) | (probe << 8);
+	uint16_t negated_swapped = -swapped;
+
+	if(id == 0) {
+		return SIG_ZERO;
+	} else if(id == probe) {
+		return SIG_ECHO;
+	} else if(id == negated || id == (uint16_t)((negated_swapped >> 8) | (negated_swapped << 8))) {
+		return SIG_NEGATED;
+	}
+	return SIG_OTHER;
+}
+
+static SignatureValue timestamp_value(const ReplyInfo& reply, uint32_t probe) {
+	if(!(reply.options & SCAN_OPT_TIMESTAMP)) {
+		return SIG_ABSENT;
+	} else if(reply.ts_val == 0) {
+		return SIG_ZERO;
+	} else if(reply.ts_val == probe) {
+		return SIG_ECHO;
+	}
+	return SIG_OTHER;
+}
+
+const Signature* SignatureTable::match(const ReplyInfo& reply, uint16_t probe_ip_id, uint32_t probe_ts_val) const {
+	const Signature* best = NULL;
+	SignatureValue ip_id = ip_id_value(reply.ip_id, probe_ip_id);
+	SignatureValue timestamp = timestamp_value(reply, probe_ts_val);
+
+	for(vector<Signature>::const_iterator s = signatures.begin(); s != signatures.end(); s++) {
+		if(reply.window < s->win_min || reply.window > s->win_max) {
+			continue;
+		}
+		if(reply.ttl < s->ttl_min || reply.ttl > s->ttl_max) {
+			continue;
+		}
+		if(s->ip_id != SIG_ANY && s->ip_id != ip_id && !(s->ip_id == SIG_NONZERO && ip_id != SIG_ZERO)) {
+			continue;
+		}
+		if(s->timestamp != SIG_ANY && s->timestamp != timestamp) {
+			continue;
+		}
+		if(!s->any_options) {
+			if(reply.option_count != s->options.size()) {
+				continue;
+			}
+			if(s->options.size() > 0 && 0 != memcmp(reply.option_kinds, &s->options[0], s->options.size())) {
+				continue;
+			}
+		}
+		if(!best || s->confidence > best->confidence) {
+			best = &*s;
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,97 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "scan_record.h"
+#include "reply_parser.h"
+
+using namespace std;
+
+/* Classifies a host from its SYN/ACK alone by comparing the reply against
+   a table of known tarpit fingerprints. Each signature constrains the
+   window, TTL, IP ID, TCP option layout and timestamp, and carries the
+   result it implies and how sure we are of it (0-100). A verdict below the
+   caller's threshold is treated as ambiguous, and the scan falls back to the
+   option and window checks and the ACK and data probes.
+
+   Signature files have one signature per line, with '#' comments:
+
+     # name  result    window ttl   ipid     options timestamp confidence
+     labrea  labrea    1-10   *     other    -       -         80
+
+   window and ttl are a value, a min-max range or '*'. ipid compares the
+   reply's IP ID with our SYN's: zero, nonzero, echo (the same), negated
+   (its two's complement, in either byte order), other (none of those) or
+   '*'. options is '-' for no options, '*' for any, or the option kinds in
+   the order they appear, e.g. 2,1,1,4,8 (NOP=1, EOL=0). timestamp looks at
+   the TSval of the reply: '-' for no timestamp option, zero, echo (our own
+   TSval copied back), other or '*'. Files with the older seven columns,
+   without timestamp, are still read. */
+
+enum SignatureValue {	SIG_ANY,
+						SIG_ABSENT,		/* Timestamp only */
+						SIG_ZERO,
+						SIG_NONZERO,	/* IP ID only */
+						SIG_ECHO,
+						SIG_NEGATED,	/* IP ID only */
+						SIG_OTHER };
+
+struct Signature {
+	string name;
+	ScanResult result;
+	uint32_t win_min, win_max;
+	uint8_t ttl_min, ttl_max;
+	SignatureValue ip_id;
+	bool any_options;
+	vector<uint8_t> options;	/* Option kinds in order, empty for none */
+	SignatureValue timestamp;
+	uint8_t confidence;
+};
+
+class SignatureTable {
+	public:
+		SignatureTable();
+
+		/* Add the built-in signatures */
+		void add_defaults();
+
+		/* Add signatures from a file. Returns false on a read or parse error. */
+		bool load(const char* filename);
+
+		/* Find the most confident signature matching a SYN/ACK to a SYN sent
+		   with the given IP ID and TSval. Returns NULL if nothing matches. */
+		const Signature* match(const ReplyInfo& reply, uint16_t probe_ip_id, uint32_t probe_ts_val) const;
+
+		size_t size() const;
+
+	private:
+		bool parse_line(char* line, Signature* sig);
+
+		vector<Signature> signatures;
+};
+
+#endif /* SIGNATURE_H */
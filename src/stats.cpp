@@ -0,0 +1,169 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stats.h"
+#include "scan_record.h"
+
+static __thread Stats* current_stats = NULL;
+static __thread LatencyStats* current_latency = NULL;
+static Stats fallback_stats;
+static LatencyStats fallback_latency;
+
+void Stats::clear() {
+	memset(this, 0, sizeof(*this));
+}
+
+void Stats::add(const Stats& s) {
+	scans += __atomic_load_n(&s.scans, __ATOMIC_RELAXED);
+	hits += __atomic_load_n(&s.hits, __ATOMIC_RELAXED);
+	tarpits += __atomic_load_n(&s.tarpits, __ATOMIC_RELAXED);
+	labrea += __atomic_load_n(&s.labrea, __ATOMIC_RELAXED);
+	iptables += __atomic_load_n(&s.iptables, __ATOMIC_RELAXED);
+	delude += __atomic_load_n(&s.delude, __ATOMIC_RELAXED);
+	excluded += __atomic_load_n(&s.excluded, __ATOMIC_RELAXED);
+	skipped += __atomic_load_n(&s.skipped, __ATOMIC_RELAXED);
+	unchanged += __atomic_load_n(&s.unchanged, __ATOMIC_RELAXED);
+	retried += __atomic_load_n(&s.retried, __ATOMIC_RELAXED);
+	dark_skipped += __atomic_load_n(&s.dark_skipped, __ATOMIC_RELAXED);
+	errors += __atomic_load_n(&s.errors, __ATOMIC_RELAXED);
+	real += __atomic_load_n(&s.real, __ATOMIC_RELAXED);
+	rejecting += __atomic_load_n(&s.rejecting, __ATOMIC_RELAXED);
+	unreachable += __atomic_load_n(&s.unreachable, __ATOMIC_RELAXED);
+	zero_win += __atomic_load_n(&s.zero_win, __ATOMIC_RELAXED);
+	packets_sent += __atomic_load_n(&s.packets_sent, __ATOMIC_RELAXED);
+	send_errors += __atomic_load_n(&s.send_errors, __ATOMIC_RELAXED);
+	packets_recv += __atomic_load_n(&s.packets_recv, __ATOMIC_RELAXED);
+	recv_dropped += __atomic_load_n(&s.recv_dropped, __ATOMIC_RELAXED);
+	in_flight += __atomic_load_n(&s.in_flight, __ATOMIC_RELAXED);
+}
+
+void LatencyStats::clear() {
+	for(int i = 0; i < LATENCY_CLASSES; i++) {
+		response_time[i].clear();
+	}
+}
+
+void LatencyStats::add(const LatencyStats& l) {
+	for(int i = 0; i < LATENCY_CLASSES; i++) {
+		response_time[i].merge(l.response_time[i]);
+	}
+}
+
+void LatencyStats::record(int result, uint32_t usec) {
+	int c = result_class(result);
+	if(c >= 0) {
+		response_time[c].record(usec);
+	}
+}
+
+int LatencyStats::result_class(int result) {
+	switch(result) {
+		case REAL_HOST:		return LATENCY_REAL_HOST;
+		case REJECT:		return LATENCY_REJECT;
+		case UNREACHABLE:	return LATENCY_UNREACHABLE;
+		case ZERO_WIN:		return LATENCY_ZERO_WIN;
+		case TARPIT:		return LATENCY_TARPIT;
+		case LABREA:		return LATENCY_LABREA;
+		case IPTABLES:		return LATENCY_IPTABLES;
+		case DELUDE:		return LATENCY_DELUDE;
+		default:			return -1;
+	}
+}
+
+const char* LatencyStats::class_name(int c) {
+	switch(c) {
+		case LATENCY_REAL_HOST:		return "real_host";
+		case LATENCY_REJECT:		return "reject";
+		case LATENCY_UNREACHABLE:	return "unreachable";
+		case LATENCY_ZERO_WIN:		return "zero_window";
+		case LATENCY_TARPIT:		return "tarpit";
+		case LATENCY_LABREA:		return "labrea";
+		case LATENCY_IPTABLES:		return "iptables";
+		case LATENCY_DELUDE:		return "delude";
+		default:					return "unknown";
+	}
+}
+
+StatsRegistry::StatsRegistry() {
+	pthread_mutex_init(&lock, NULL);
+}
+
+StatsRegistry::~StatsRegistry() {
+	for(vector<Shard*>::iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+		free(*iter);
+	}
+	pthread_mutex_destroy(&lock);
+}
+
+Stats* StatsRegistry::attach() {
+	void* mem;
+
+	if(0 != posix_memalign(&mem, 64, sizeof(Shard))) {
+		fprintf(stderr, "error: failed to allocate statistics counters\n");
+		exit(EXIT_FAILURE);
+	}
+
+	Shard* s = (Shard*)mem;
+	s->counters.clear();
+	s->latency.clear();
+
+	pthread_mutex_lock(&lock);
+	shards.push_back(s);
+	pthread_mutex_unlock(&lock);
+
+	current_stats = &s->counters;
+	current_latency = &s->latency;
+	return current_stats;
+}
+
+void StatsRegistry::aggregate(Stats* out) const {
+	out->clear();
+
+	pthread_mutex_lock(&lock);
+	for(vector<Shard*>::const_iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+		out->add((*iter)->counters);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void StatsRegistry::aggregate_latency(LatencyStats* out) const {
+	out->clear();
+
+	pthread_mutex_lock(&lock);
+	for(vector<Shard*>::const_iterator iter = shards.begin(); iter != shards.end(); ++iter) {
+		out->add((*iter)->latency);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+Stats* stats_thread() {
+	return current_stats ? current_stats : &fallback_stats;
+}
+
+LatencyStats* latency_thread() {
+	return current_latency ? current_latency : &fallback_latency;
+}
@@ -0,0 +1,126 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include "histogram.h"
+
+using namespace std;
+
+/* Scan counters. Every scanning thread owns one Stats block, padded out to
+   whole cache lines, and is the only writer of it. Updates are plain loads
+   and stores, so they cost no more than an ordinary increment, and readers
+   sum up all the blocks when they need totals. */
+struct Stats {
+	uint64_t scans;
+	uint64_t hits;
+	uint64_t tarpits;
+	uint64_t labrea;
+	uint64_t iptables;
+	uint64_t delude;
+	uint64_t excluded;
+	uint64_t skipped;
+	uint64_t unchanged;
+	uint64_t retried;
+	uint64_t dark_skipped;
+	uint64_t errors;
+	uint64_t real;
+	uint64_t rejecting;
+	uint64_t unreachable;
+	uint64_t zero_win;
+	uint64_t packets_sent;
+	uint64_t send_errors;
+	uint64_t packets_recv;
+	uint64_t recv_dropped;
+	uint64_t in_flight;
+
+	void clear();
+	void add(const Stats& s);
+} __attribute__((aligned(64)));
+
+/* Increment/decrement a counter in the calling thread's own block. The
+   relaxed atomic load/store pair compiles to plain moves but keeps readers
+   on other threads from seeing torn values. */
+#define STATS_ADD(field, n) do { \
+		Stats* _s = stats_thread(); \
+		__atomic_store_n(&_s->field, __atomic_load_n(&_s->field, __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED); \
+	} while(0)
+#define STATS_INC(field) STATS_ADD(field, 1)
+#define STATS_DEC(field) STATS_ADD(field, -1)
+
+/* Result classes that get their own response time histogram */
+enum LatencyClass {	LATENCY_REAL_HOST,
+					LATENCY_REJECT,
+					LATENCY_UNREACHABLE,
+					LATENCY_ZERO_WIN,
+					LATENCY_TARPIT,
+					LATENCY_LABREA,
+					LATENCY_IPTABLES,
+					LATENCY_DELUDE,
+					LATENCY_CLASSES };
+
+/* SYN/ACK response times (microseconds) by result. Kept per thread next to
+   the counters and merged on demand, like Stats. */
+struct LatencyStats {
+	Histogram response_time[LATENCY_CLASSES];
+
+	void clear();
+	void add(const LatencyStats& l);
+	void record(int result, uint32_t usec);
+
+	/* Returns -1 for results that don't have a histogram */
+	static int result_class(int result);
+	static const char* class_name(int c);
+};
+
+class StatsRegistry {
+	public:
+		StatsRegistry();
+		~StatsRegistry();
+
+		/* Allocate a block for the calling thread and make it current */
+		Stats* attach();
+
+		/* Sum of all blocks */
+		void aggregate(Stats* out) const;
+		void aggregate_latency(LatencyStats* out) const;
+
+	private:
+		struct Shard {
+			Stats counters;
+			LatencyStats latency;
+		};
+
+		mutable pthread_mutex_t lock;
+		vector<Shard*> shards;
+};
+
+/* Blocks of the calling thread. Threads that never called attach() share a
+   fallback block that is never aggregated. */
+Stats* stats_thread();
+LatencyStats* latency_thread();
+
+#endif /* STATS_H */
@@ -61,6 +61,13 @@ uint32_t SubnetList::offset() {
 	return addr_offset;
 }
 
+list<Subnet> SubnetList::get_subnets() {
+	pthread_mutex_lock(&lock);
+	list<Subnet> copy = subnets;
+	pthread_mutex_unlock(&lock);
+	return copy;
+}
+
 
 uint32_t SubnetList::next_address() {
 	uint32_t next = 0;
@@ -48,6 +48,9 @@ class SubnetList {
 		uint32_t count();
 		uint32_t offset();
 
+		/* Copy of the subnets not yet fully handed out */
+		list<Subnet> get_subnets();
+
 	protected:
 		pthread_mutex_t lock;
 		list<Subnet> subnets;
@@ -0,0 +1,167 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <string>
+#include <vector>
+
+#include "degreaser.h"
+#include "trace.h"
+
+#define TRACE_RING_SIZE	(1 << 16)
+
+struct TraceEvent {
+	uint64_t ts;			/* CLOCK_MONOTONIC, nanoseconds */
+	uint16_t stage;
+	char phase;
+};
+
+struct TraceRing {
+	char name[32];
+	pid_t tid;
+	uint64_t head;			/* Total events recorded; oldest are overwritten */
+	TraceEvent events[TRACE_RING_SIZE];
+};
+
+bool trace_enabled = false;
+
+static string trace_file;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static vector<TraceRing*> trace_rings;
+static __thread TraceRing* current_ring = NULL;
+
+static const char* stage_names[TRACE_STAGES] = {
+	"scan",
+	"build_packet",
+	"get_my_ip",
+	"send_recv",
+	"send",
+	"parse",
+	"pcap",
+	"output",
+};
+
+void trace_init(string filename) {
+	trace_file = filename;
+	trace_enabled = true;
+}
+
+void trace_attach(const char* thread_name) {
+	if(!trace_enabled || current_ring) {
+		return;
+	}
+
+	TraceRing* r = (TraceRing*)malloc(sizeof(TraceRing));
+	if(!r) {
+		fprintf(stderr, "warning: failed to allocate trace buffer. Thread will not be traced.\n");
+		return;
+	}
+	snprintf(r->name, sizeof(r->name), "%s", thread_name);
+	r->tid = syscall(SYS_gettid);
+	r->head = 0;
+
+	pthread_mutex_lock(&trace_lock);
+	trace_rings.push_back(r);
+	pthread_mutex_unlock(&trace_lock);
+
+	current_ring = r;
+}
+
+void trace_event(TraceStage stage, char phase) {
+	struct timespec ts;
+	TraceRing* r = current_ring;
+
+	if(!r) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	TraceEvent& e = r->events[r->head & (TRACE_RING_SIZE - 1)];
+	e.ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	e.stage = stage;
+	e.phase = phase;
+	r->head++;
+}
+
+static void trace_dump_ring(FILE* fd, TraceRing* r, bool* first) {
+	uint64_t start = r->head > TRACE_RING_SIZE ? r->head - TRACE_RING_SIZE : 0;
+	int depth = 0;
+
+	fprintf(fd, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			*first ? "" : ",\n", getpid(), r->tid, r->name);
+	*first = false;
+
+	for(uint64_t i = start; i < r->head; i++) {
+		TraceEvent& e = r->events[i & (TRACE_RING_SIZE - 1)];
+
+		/* A ring that wrapped can start in the middle of a stage. Drop end
+		   events whose begin was overwritten so the nesting stays valid. */
+		if(e.phase == 'E') {
+			if(depth == 0) {
+				continue;
+			}
+			depth--;
+		} else {
+			depth++;
+		}
+
+		fprintf(fd, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d}",
+				stage_names[e.stage], e.phase,
+				(unsigned long long)(e.ts / 1000), (unsigned long long)(e.ts % 1000),
+				getpid(), r->tid);
+	}
+}
+
+void trace_dump() {
+	bool first = true;
+
+	if(!trace_enabled) {
+		return;
+	}
+	trace_enabled = false;
+
+	FILE* fd = fopen(trace_file.c_str(), "w");
+	if(!fd) {
+		fprintf(stderr, "error: failed to open trace file '%s'. Reason: %s\n", trace_file.c_str(), strerror(errno));
+		return;
+	}
+
+	fprintf(fd, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	pthread_mutex_lock(&trace_lock);
+	for(vector<TraceRing*>::iterator iter = trace_rings.begin(); iter != trace_rings.end(); ++iter) {
+		trace_dump_ring(fd, *iter, &first);
+		free(*iter);
+	}
+	trace_rings.clear();
+	pthread_mutex_unlock(&trace_lock);
+	fprintf(fd, "\n]}\n");
+
+	fclose(fd);
+}
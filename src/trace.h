@@ -0,0 +1,66 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+/* Lightweight per-stage tracing. Each thread that calls trace_attach() gets
+   its own ring of timestamped begin/end events, so recording an event never
+   takes a lock. Rings are written out as Chrome/Perfetto trace JSON by
+   trace_dump() once all threads have finished. When tracing has not been
+   enabled, every TRACE_* macro is a single predictable branch. */
+
+enum TraceStage {	TRACE_SCAN,
+					TRACE_BUILD_PACKET,
+					TRACE_GET_MY_IP,
+					TRACE_SEND_RECV,
+					TRACE_SEND,
+					TRACE_PARSE,
+					TRACE_PCAP,
+					TRACE_OUTPUT,
+					TRACE_STAGES };
+
+extern bool trace_enabled;
+
+#define TRACE_BEGIN(stage) do { \
+		if(__builtin_expect(trace_enabled, 0)) trace_event(stage, 'B'); \
+	} while(0)
+#define TRACE_END(stage) do { \
+		if(__builtin_expect(trace_enabled, 0)) trace_event(stage, 'E'); \
+	} while(0)
+
+/* Enable tracing. Must be called before any threads attach. */
+void trace_init(string filename);
+
+/* Allocate a ring for the calling thread. Does nothing if tracing is off. */
+void trace_attach(const char* thread_name);
+
+void trace_event(TraceStage stage, char phase);
+
+/* Write all rings to the trace file. Call after all traced threads exit. */
+void trace_dump();
+
+#endif /* TRACE_H */
@@ -0,0 +1,86 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "unreachable_cache.h"
+#include "scan_record.h"
+
+enum UnreachableMode {	UNREACH_LEARNING,	/* Probing every address, counting errors */
+						UNREACH_DARK,		/* Declared unreachable, sampling only */
+						UNREACH_ALIVE };	/* Something answered, always probe */
+
+/* Destination unreachable codes that speak for the whole prefix: network
+   and host unreachable, and the administratively prohibited variants */
+static bool is_prefix_error(uint8_t code) {
+	return code == 0 || code == 1 || code == 9 || code == 10 || code == 13;
+}
+
+UnreachableCache::UnreachableCache(uint16_t t, uint16_t s) {
+	threshold = t ? t : 1;
+	sample_rate = s;
+}
+
+UnreachableCache::~UnreachableCache() { }
+
+bool UnreachableCache::should_skip(uint32_t addr) {
+	return prefixes.should_skip(addr, sample_rate);
+}
+
+void UnreachableCache::record(uint32_t addr, int result, uint32_t router, uint8_t code) {
+	if(result == NO_RESPONSE || result == DRY_RUN || result == NOT_SCANNED) {
+		return;
+	}
+	if(result == UNREACHABLE && (router == 0 || !is_prefix_error(code))) {
+		return;
+	}
+
+	UnreachablePrefix* p = prefixes.lock(addr);
+	p->probed++;
+
+	if(result != UNREACHABLE) {
+		p->state = UNREACH_ALIVE;
+	} else if(p->state == UNREACH_LEARNING) {
+		/* Errors only add up per router. Past the first few routers seen
+		   for a prefix, more are ignored. */
+		for(int i = 0; i < UNREACHABLE_ROUTERS; i++) {
+			if(p->routers[i] == 0) {
+				p->routers[i] = router;
+			}
+			if(p->routers[i] == router) {
+				p->code = code;
+				if(++p->errors[i] >= threshold) {
+					p->state = UNREACH_DARK;
+				}
+				break;
+			}
+		}
+	}
+	p->sample.active = (p->state == UNREACH_DARK);
+	prefixes.unlock(p);
+}
+
+uint32_t UnreachableCache::dark_prefixes() {
+	return prefixes.sampled_prefixes();
+}
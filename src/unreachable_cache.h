@@ -0,0 +1,71 @@
+/*  ------------------------------------------------------------------------
+    degreaser - A tool for detecting network tarpits.
+    Copyright (c) 2014, Lance Alt
+
+    This file is part of degreaser.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    ------------------------------------------------------------------------
+*/
+
+
+#ifndef UNREACHABLE_CACHE_H
+#define UNREACHABLE_CACHE_H
+
+#include <stdint.h>
+
+#include "prefix_map.h"
+
+/* Skips /24s that routers have declared unreachable. ICMP net and host
+   unreachable and administratively prohibited errors are counted per /24
+   and per router that sent them. Once one router has sent threshold of
+   them for a /24, and nothing in it has answered, the rest of the /24 is
+   considered dark and only one address in every sample_rate is probed
+   (none if sample_rate is 0). A real answer from any address in the /24
+   puts it back to full scanning for good. */
+
+#define UNREACHABLE_ROUTERS	4
+
+struct UnreachablePrefix {
+	uint32_t prefix;			/* Address >> 8, host byte order */
+	uint32_t routers[UNREACHABLE_ROUTERS];	/* Routers that sent errors (network byte order) */
+	uint16_t errors[UNREACHABLE_ROUTERS];	/* Errors from each */
+	uint8_t code;				/* ICMP code of the last error */
+	uint8_t state;
+	uint32_t probed;
+	PrefixSample sample;		/* Active while dark */
+};
+
+class UnreachableCache {
+	public:
+		UnreachableCache(uint16_t threshold, uint16_t sample_rate);
+		~UnreachableCache();
+
+		/* Returns true if addr (network byte order) should not be probed
+		   because its /24 is dark */
+		bool should_skip(uint32_t addr);
+
+		/* Feed in the result of a scan of addr (network byte order). router
+		   and code describe the ICMP error for UNREACHABLE results. */
+		void record(uint32_t addr, int result, uint32_t router, uint8_t code);
+
+		uint32_t dark_prefixes();
+
+	private:
+		uint16_t threshold;
+		uint16_t sample_rate;
+		PrefixMap<UnreachablePrefix> prefixes;
+};
+
+#endif /* UNREACHABLE_CACHE_H */